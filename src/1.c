@@ -1,55 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include "adventfiles.h"
 
+#if !defined(FUEL_SCALAR) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define FUEL_AVX2 1
+#endif
+
 #define INPUT "./inputs/1.txt"
 
-int calculateFuel(char *, bool);
-void handleLine(char *line, void *context);
-int weightToFuel(int);
-int weightToFuelRecursive(int);
+// Recursive fuel for every mass below this is precomputed, so a module only iterates the recurrence
+// until its mass drops under it. Masses that fit in 32 bits are batched up for the kernel, which
+// runs eight modules at a time in AVX2 lanes where the target has them.
+#define FUEL_TABLE_SIZE (1 << 16)
+#define FUEL_BATCH 4096
+
+// Usage: 1 [module list]
+//        1 -b count
+// Reads ./inputs/1.txt by default, or standard input if the list is "-". Both totals are computed
+// in one pass over the list, so it can be streamed however long it is. With -b, the ways of
+// computing the recursive total are timed against each other on count synthetic masses instead.
+
+void handleLine(const char *line, size_t length, void *context);
+long long parseWeight(const char *line, size_t length);
+long long weightToFuel(long long);
+long long weightToFuelRecursive(long long);
+void buildFuelTable();
+long long fuelFromTable(unsigned int);
+long long recursiveFuelBatch(const unsigned int *weights, size_t count);
+int benchmark(long long count);
 
 typedef struct {
-    int totalWeight;
-    bool isRecursive;
+    long long naiveFuel;
+    long long recursiveFuel;
+    unsigned int batch[FUEL_BATCH]; // Masses waiting for the recursive fuel kernel.
+    size_t batched;
 } state;
 
+static unsigned int fuelTable[FUEL_TABLE_SIZE];
+
 int main(int argc, char **argv) {
-    int fuelNeededNaive = calculateFuel(INPUT, false);
-    int fuelNeededRecursive = calculateFuel(INPUT, true);
-    printf("Fuel required (naive): %d.\n", fuelNeededNaive);
-    printf("Fuel required (recursive): %d.\n", fuelNeededRecursive);
+    buildFuelTable();
+    if (argc > 2 && strcmp(argv[1], "-b") == 0) {
+        return benchmark(atoll(argv[2]));
+    }
+
+    const char *input = (argc > 1) ? argv[1] : INPUT;
+    static state s;
+    if (!adv_forLineSpanInFile(input, &handleLine, &s)) {
+        return 1;
+    }
+    s.recursiveFuel += recursiveFuelBatch(s.batch, s.batched);
+    printf("Fuel required (naive): %lld.\n", s.naiveFuel);
+    printf("Fuel required (recursive): %lld.\n", s.recursiveFuel);
     return 0;
 }
 
-int calculateFuel(char *filename, bool recursive) {
-    state s = {0, recursive};
-    adv_forLineInFile(filename, &handleLine, &s);
-    return s.totalWeight;
+void handleLine(const char *line, size_t length, void *context) {
+    state *s = (state *)context;
+    long long moduleWeight = parseWeight(line, length);
+    s->naiveFuel += weightToFuel(moduleWeight);
+    if (moduleWeight > 0xFFFFFFFFLL) {
+        s->recursiveFuel += weightToFuelRecursive(moduleWeight);
+        return;
+    }
+    s->batch[s->batched++] = (unsigned int)moduleWeight;
+    if (s->batched == FUEL_BATCH) {
+        s->recursiveFuel += recursiveFuelBatch(s->batch, s->batched);
+        s->batched = 0;
+    }
 }
 
-void handleLine(char *line, void *context) {
-    state *s = (state *)context;
-    int moduleWeight = atoi(line);
-    if (s->isRecursive) {
-        s->totalWeight += weightToFuelRecursive(moduleWeight);
-    } else {
-        s->totalWeight += weightToFuel(moduleWeight);
+// Lines aren't NUL-terminated, so atoi can't be used; like atoi, this stops at the first non-digit.
+long long parseWeight(const char *line, size_t length) {
+    long long weight = 0;
+    for (size_t i = 0; i < length && line[i] >= '0' && line[i] <= '9'; i++) {
+        weight = weight * 10 + (line[i] - '0');
     }
+    return weight;
 }
 
-int weightToFuel(int moduleWeight) {
+long long weightToFuel(long long moduleWeight) {
     return (moduleWeight / 3) - 2;
 }
 
-int weightToFuelRecursive(int moduleWeight) {
-    int total = 0;
-    int newWeight = weightToFuel(moduleWeight);
+long long weightToFuelRecursive(long long moduleWeight) {
+    long long total = 0;
+    long long newWeight = weightToFuel(moduleWeight);
     while (newWeight > 0) {
         total += newWeight;
         newWeight = weightToFuel(newWeight);
     }
     return total;
 }
+
+// The fuel for a mass is lighter than the mass, so each entry only needs the ones before it.
+void buildFuelTable() {
+    for (unsigned int weight = 0; weight < FUEL_TABLE_SIZE; weight++) {
+        long long fuel = weightToFuel(weight);
+        fuelTable[weight] = (fuel > 0) ? (unsigned int)fuel + fuelTable[fuel] : 0;
+    }
+}
+
+long long fuelFromTable(unsigned int weight) {
+    long long total = 0;
+    while (weight >= FUEL_TABLE_SIZE) {
+        weight = weight / 3 - 2;
+        total += weight;
+    }
+    return total + fuelTable[weight];
+}
+
+#if defined(FUEL_AVX2)
+
+// Exact unsigned division by three of each 32-bit lane: the high half of x * 0xAAAAAAAB, shifted.
+static inline __m256i divide_by_three(__m256i x) {
+    __m256i magic = _mm256_set1_epi32((int)0xAAAAAAABu);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, magic), 33);
+    __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), magic), 33);
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+// Every lane steps through the recurrence until all of them are inside the table; lanes that get
+// there early are masked out of the remaining steps. A module's total is below 2^31, so the lanes
+// only widen to 64 bits when they are added to the running sum.
+long long recursiveFuelBatch(const unsigned int *weights, size_t count) {
+    __m256i tableSize = _mm256_set1_epi32(FUEL_TABLE_SIZE);
+    __m256i two = _mm256_set1_epi32(2);
+    __m256i sums = _mm256_setzero_si256();
+    size_t vectorCount = count - count % 8;
+    for (size_t i = 0; i < vectorCount; i += 8) {
+        __m256i weight = _mm256_loadu_si256((const __m256i *)(weights + i));
+        __m256i total = _mm256_setzero_si256();
+        __m256i outside = _mm256_cmpeq_epi32(_mm256_max_epu32(weight, tableSize), weight);
+        while (!_mm256_testz_si256(outside, outside)) {
+            __m256i fuel = _mm256_sub_epi32(divide_by_three(weight), two);
+            weight = _mm256_blendv_epi8(weight, fuel, outside);
+            total = _mm256_add_epi32(total, _mm256_and_si256(fuel, outside));
+            outside = _mm256_cmpeq_epi32(_mm256_max_epu32(weight, tableSize), weight);
+        }
+        total = _mm256_add_epi32(total, _mm256_i32gather_epi32((const int *)fuelTable, weight, 4));
+        sums = _mm256_add_epi64(sums, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(total)));
+        sums = _mm256_add_epi64(sums, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(total, 1)));
+    }
+
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, sums);
+    long long sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (size_t i = vectorCount; i < count; i++) {
+        sum += fuelFromTable(weights[i]);
+    }
+    return sum;
+}
+
+#else
+
+long long recursiveFuelBatch(const unsigned int *weights, size_t count) {
+    long long sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += fuelFromTable(weights[i]);
+    }
+    return sum;
+}
+
+#endif
+
+static double secondsSince(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Masses are spread over the whole 32-bit range, with a quarter of them at puzzle-input sizes.
+int benchmark(long long count) {
+    unsigned int *weights = malloc(sizeof(unsigned int) * count);
+    if (count < 1 || weights == 0) {
+        fprintf(stderr, "ERROR: Could not make %lld synthetic masses.\n", count);
+        return 1;
+    }
+    unsigned long long seed = 88172645463325252ULL;
+    for (long long i = 0; i < count; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        weights[i] = (seed % 4 == 0) ? 50000 + (seed >> 8) % 100000 : (unsigned int)(seed >> 32);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long iterated = 0;
+    for (long long i = 0; i < count; i++) {
+        iterated += weightToFuelRecursive(weights[i]);
+    }
+    double seconds = secondsSince(&start);
+    printf("Iterated: %lld in %.3fs (%.1f M masses/s).\n", iterated, seconds, count / seconds / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long tabled = 0;
+    for (long long i = 0; i < count; i++) {
+        tabled += fuelFromTable(weights[i]);
+    }
+    seconds = secondsSince(&start);
+    printf("Table:    %lld in %.3fs (%.1f M masses/s).\n", tabled, seconds, count / seconds / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long batched = 0;
+    for (long long i = 0; i < count; i += FUEL_BATCH) {
+        batched += recursiveFuelBatch(weights + i, (count - i < FUEL_BATCH) ? count - i : FUEL_BATCH);
+    }
+    seconds = secondsSince(&start);
+#if defined(FUEL_AVX2)
+    printf("AVX2:     %lld in %.3fs (%.1f M masses/s).\n", batched, seconds, count / seconds / 1e6);
+#else
+    printf("Batched:  %lld in %.3fs (%.1f M masses/s).\n", batched, seconds, count / seconds / 1e6);
+#endif
+
+    free(weights);
+    if (tabled != iterated || batched != iterated) {
+        fprintf(stderr, "ERROR: The recursive fuel totals disagree.\n");
+        return 1;
+    }
+    return 0;
+}
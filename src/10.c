@@ -18,18 +18,17 @@ Coord get_best_vantage_point(const CoordList *asteroids) {
     Coord *bestCoord = 0;
     int bestVisibleCount = -1;
 
-    debug("Checking for best candidates in list of %d asteroids.\n",
-            asteroids->count);
+    trace_info(TRACE_DAY, "Checking for best candidates in list of %d asteroids.", asteroids->count);
     for (Coord *candidate = asteroids->coords;
             candidate < asteroids->coords + asteroids->count;
             candidate++) {
         int visibleCount = get_visible_asteroids(asteroids, candidate);
-        debug("Candidate (%d,%d) has %d visible asteroids.\n",
+        trace_trace(TRACE_DAY, "Candidate (%d,%d) has %d visible asteroids.",
                 candidate->x,
                 candidate->y,
                 visibleCount);
         if (visibleCount > bestVisibleCount) {
-            debug("\tThat's a new best score!\n");
+            trace_trace(TRACE_DAY, "That's a new best score!");
             bestVisibleCount = visibleCount;
             bestCoord = candidate;
         }
@@ -2,8 +2,7 @@
 #include <stdlib.h>
 #include <math.h>
 
-#define DEBUG_ENABLE 0
-#include <debug.h>
+#include "debug.h"
 
 #define PI 3.141592653589
 #define EPSILON 0.000001
@@ -1,141 +1,396 @@
-#include <stdio.h>
-#include <stdbool.h>
-#include <stdlib.h>
+#define _POSIX_C_SOURCE 200809L
+#include <limits.h>
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
+#include "intcode.h"
+
+#include "debug.h"
 
 #define PROGRAM_PATH "./inputs/2.txt"
+#define MAX_NOUN 100
+#define MAX_VERB 100
+#define MAX_WORKERS 64
+#define MAX_DEGREE 4
+
+// A polynomial in noun and verb; coefficients[i][j] multiplies noun^i * verb^j.
+typedef struct {
+    long long coefficients[MAX_DEGREE + 1][MAX_DEGREE + 1];
+} Polynomial;
 
+// Shared by the workers of a parallel search. Nouns are handed out one row of verbs at a time;
+// 'found' holds the lowest noun * MAX_VERB + verb known to produce the target, so each worker
+// abandons anything past it, and the answer is the same one the serial search gives.
 typedef struct {
-    int *instructions;
-    int size;
-} *program, s_program;
+    Tape *original; // Never written; every guess runs on a copy-on-write clone.
+    long long output;
+    int nextNoun;
+    int found;
+} SearchJob;
 
-program readProgram(char*, int);
-void runProgram(program, int noun, int verb);
-void freeProgram(program);
-bool loadArgs(program, int, int *, int *, int *);
-void seekInputsForOutput(char *, int, int *, int*);
+void runProgram(Tape *, int noun, int verb);
+void seekInputsForOutput(Tape *, long long, int *, int*);
+void seekInputsForOutputParallel(Tape *, long long, int threads, int *, int *);
+void *search_worker(void *);
+int default_thread_count();
+bool runProgramSymbolic(Tape *, Polynomial *result);
+bool solveForOutput(Polynomial *, long long, int *, int *);
+long long outputFor(Tape *, int noun, int verb);
 
 int main(int argc, char **argv) {
-    program prog = readProgram(PROGRAM_PATH, 100000);
+    Tape *original = tape_load(PROGRAM_PATH);
+    Tape *prog = tape_clone(original);
 
     runProgram(prog, 12, 2);
-    printf("Instruction 0 of program with input 1202 is %d.\n", prog->instructions[0]);
+    printf("Instruction 0 of program with input 1202 is %lld.\n", tape_get(prog, 0));
 
+    // Straight-line arithmetic can be solved outright; anything else falls back to searching, where
+    // an explicit thread count of 1 runs the plain serial search.
+    int threads = (argc > 1) ? atoi(argv[1]) : default_thread_count();
     int noun;
     int verb;
-    seekInputsForOutput(PROGRAM_PATH, 19690720, &noun, &verb);
+    Polynomial result;
+    if (runProgramSymbolic(original, &result) && solveForOutput(&result, 19690720, &noun, &verb)
+            && (verb < 0 || outputFor(original, noun, verb) == 19690720)) {
+        trace_info(TRACE_DAY, "Solved symbolically.");
+    } else if (threads <= 1) {
+        seekInputsForOutput(original, 19690720, &noun, &verb);
+    } else {
+        seekInputsForOutputParallel(original, 19690720, threads, &noun, &verb);
+    }
     printf("Output produced with noun %d and verb %d.\n", noun, verb);
 
-    freeProgram(prog);
+    tape_free(prog);
+    tape_free(original);
 }
 
-program readProgram(char *path, int size) {
-    program prog = malloc(sizeof(s_program));
-    prog->instructions = malloc(sizeof(int) * size);
-    prog->size = size;
-
-    FILE *fPtr = fopen(path, "r");
-    int index = 0;
-    int item;
+void runProgram(Tape *tape, int noun, int verb) {
+    tape_update(tape, 1, noun);
+    tape_update(tape, 2, verb);
 
-    while(index < size && fscanf(fPtr, "%d,", &item) != -1) {
-        prog ->instructions[index] = item;
-        index++;
+    State *state = state_init(tape);
+    run(state);
+    if (state->status == ERROR) {
+        fprintf(stderr, "Halting execution due to error.\n");
     }
+    state_free(state);
+}
 
-    if (index < size) {
-        // Last element needs special handling as it doesn't terminate in a ','
-        fscanf(fPtr, "%d", &item);
-        prog->instructions[index] = item;
-    }
+long long outputFor(Tape *original, int noun, int verb) {
+    Tape *p = tape_clone(original);
+    runProgram(p, noun, verb);
+    long long result = tape_get(p, 0);
+    tape_free(p);
+    return result;
+}
 
-    if (index >= size) {
-        fprintf(stderr, "Out of space at index %d when loading program. Truncating.\n", index);
+void seekInputsForOutput(Tape *original, long long output, int *noun, int *verb) {
+    for (int nounGuess = 0; nounGuess < MAX_NOUN; nounGuess++) {
+        for (int verbGuess = 0; verbGuess < MAX_VERB; verbGuess++) {
+            Tape *p = tape_clone(original);
+            runProgram(p, nounGuess, verbGuess);
+            long long result = tape_get(p, 0);
+            tape_free(p);
+            if (result == output) {
+                *noun = nounGuess;
+                *verb = verbGuess;
+                return;
+            }
+        }
     }
 
-    fclose(fPtr);
-    return prog;
+    *noun = 1;
+    *verb = -1;
 }
 
-void freeProgram(program prog) {
-    free(prog->instructions);
-    free(prog);
-}
+void seekInputsForOutputParallel(Tape *original, long long output, int threads, int *noun, int *verb) {
+    if (threads > MAX_WORKERS) {
+        threads = MAX_WORKERS;
+    }
+
+    SearchJob job;
+    job.original = original;
+    job.output = output;
+    job.nextNoun = 0;
+    job.found = MAX_NOUN * MAX_VERB;
+
+    pthread_t workers[MAX_WORKERS];
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[started], 0, search_worker, &job) != 0) {
+            fprintf(stderr, "ERROR: Could not start search thread %d; continuing with %d.\n", i, started);
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        search_worker(&job);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], 0);
+    }
 
-void runProgram(program p, int noun, int verb) {
-    p->instructions[1] = noun;
-    p->instructions[2] = verb;
+    if (job.found == MAX_NOUN * MAX_VERB) {
+        *noun = 1;
+        *verb = -1;
+    } else {
+        *noun = job.found / MAX_VERB;
+        *verb = job.found % MAX_VERB;
+    }
+}
 
-    int index = 0;
+void *search_worker(void *context) {
+    SearchJob *job = context;
     while (1) {
-        if (index >= p->size) {
-            fprintf(stderr, "Current instruction pointer %d out of bounds (max %d).\n", index, p->size);
-            return;
+        int nounGuess = __atomic_fetch_add(&job->nextNoun, 1, __ATOMIC_RELAXED);
+        if (nounGuess >= MAX_NOUN) {
+            return 0;
         }
 
-        int instr = p->instructions[index];
-        if (instr == 1 || instr == 2) {
-            int a, b, dest;
-            bool success = loadArgs(p, index, &a, &b, &dest);
-            if (!success) {
-                fprintf(stderr, "Halting execution due to error.\n");
-                return;
+        for (int verbGuess = 0; verbGuess < MAX_VERB; verbGuess++) {
+            int guess = nounGuess * MAX_VERB + verbGuess;
+            if (guess >= __atomic_load_n(&job->found, __ATOMIC_RELAXED)) {
+                // Someone already has an answer at least as early as anything left in this row.
+                return 0;
             }
-            if (instr == 1) {
-                p->instructions[dest] = p->instructions[a] + p->instructions[b];
-            } else {
-                p->instructions[dest] = p->instructions[a] * p->instructions[b];
+
+            Tape *p = tape_clone(job->original);
+            runProgram(p, nounGuess, verbGuess);
+            long long result = tape_get(p, 0);
+            tape_free(p);
+            if (result == job->output) {
+                int best = __atomic_load_n(&job->found, __ATOMIC_RELAXED);
+                while (guess < best && !__atomic_compare_exchange_n(&job->found, &best, guess, false,
+                                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                }
+                return 0;
             }
-            index += 4;
-        } else if (instr == 99) {
-            return;
-        }  else {
-            fprintf(stderr, "Illegal instruction %d at index %d.\n", instr, index);
-            return;
         }
     }
 }
 
-void seekInputsForOutput(char *path, int output, int *noun, int *verb) {
-    for (int nounGuess = 0; nounGuess < 100; nounGuess++) {
-        for (int verbGuess = 0; verbGuess < 100; verbGuess++) {
-            program p = readProgram(path, 10000);
-            runProgram(p, nounGuess, verbGuess);
-            if (p->instructions[0] == output) {
-                *noun = nounGuess;
-                *verb = verbGuess;
-                return;
+int default_thread_count() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores < 1) ? 1 : (int)cores;
+}
+
+static bool poly_is_constant(Polynomial *p) {
+    for (int i = 0; i <= MAX_DEGREE; i++) {
+        for (int j = 0; j <= MAX_DEGREE; j++) {
+            if ((i != 0 || j != 0) && p->coefficients[i][j] != 0) {
+                return false;
             }
         }
     }
+    return true;
+}
 
-    *noun = 1;
-    *verb = -1;
+static void poly_constant(Polynomial *p, long long value) {
+    memset(p, 0, sizeof(Polynomial));
+    p->coefficients[0][0] = value;
 }
 
-bool loadArgs(program p, int index, int *a, int *b, int *dest) {
-    if (index + 3 >= p->size) {
-        fprintf(stderr, "Out of bounds during argument load at index %d (limit %d).\n", index, p->size);
-        return false;
+static bool poly_add(Polynomial *result, Polynomial *a, Polynomial *b) {
+    Polynomial sum;
+    for (int i = 0; i <= MAX_DEGREE; i++) {
+        for (int j = 0; j <= MAX_DEGREE; j++) {
+            if (__builtin_add_overflow(a->coefficients[i][j], b->coefficients[i][j], &sum.coefficients[i][j])) {
+                return false;
+            }
+        }
     }
+    *result = sum;
+    return true;
+}
 
-    *a = p->instructions[++index];
-    *b = p->instructions[++index];
-    *dest = p->instructions[++index];
+// Fails if the product overflows or needs a higher degree than a Polynomial holds.
+static bool poly_multiply(Polynomial *result, Polynomial *a, Polynomial *b) {
+    Polynomial product;
+    memset(&product, 0, sizeof(Polynomial));
+    for (int i = 0; i <= MAX_DEGREE; i++) {
+        for (int j = 0; j <= MAX_DEGREE; j++) {
+            if (a->coefficients[i][j] == 0) {
+                continue;
+            }
+            for (int k = 0; k <= MAX_DEGREE; k++) {
+                for (int l = 0; l <= MAX_DEGREE; l++) {
+                    if (b->coefficients[k][l] == 0) {
+                        continue;
+                    }
+                    long long term;
+                    if (i + k > MAX_DEGREE || j + l > MAX_DEGREE
+                            || __builtin_mul_overflow(a->coefficients[i][j], b->coefficients[k][l], &term)
+                            || __builtin_add_overflow(product.coefficients[i + k][j + l], term,
+                                                      &product.coefficients[i + k][j + l])) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    *result = product;
+    return true;
+}
 
-    if (*a >= p->size) {
-        fprintf(stderr, "Operand a destination %d out of bounds (limit %d).\n", *a, p->size);
+// Runs the program with every cell tracked as a polynomial in the noun (cell 1) and verb (cell 2),
+// leaving cell 0 at the halt in 'result'. A value read through an input-dependent address can't be
+// tracked, so its destination is marked unknown; that's only fatal if the unknown value is used
+// later. Gives up (returning false) on anything whose control flow or write addresses would depend
+// on the inputs, or that uses instructions other than ADD, MULTIPLY and HALT; the caller should
+// then run the program concretely.
+bool runProgramSymbolic(Tape *tape, Polynomial *result) {
+    long long count = tape->count;
+    if (count < 3) {
         return false;
     }
-    if (*b >= p->size) {
-        fprintf(stderr, "Operand b destination %d out of bounds (limit %d).\n", *b, p->size);
-        return false;
+
+    Polynomial *cells = malloc(sizeof(Polynomial) * count);
+    bool *known = malloc(sizeof(bool) * count);
+    for (long long i = 0; i < count; i++) {
+        poly_constant(&cells[i], tape_get(tape, i));
+        known[i] = true;
     }
-    if (*dest >= p->size) {
-        fprintf(stderr, "Operation destination %d out of bounds (limit %d).\n", *dest, p->size);
-        return false;
+    poly_constant(&cells[1], 0);
+    cells[1].coefficients[1][0] = 1;
+    poly_constant(&cells[2], 0);
+    cells[2].coefficients[0][1] = 1;
+
+    bool solved = false;
+    long long ptr = 0;
+    while (ptr >= 0 && ptr < count && known[ptr] && poly_is_constant(&cells[ptr])) {
+        DecodedInstruction instr = decode_instruction(cells[ptr].coefficients[0][0]);
+        if (instr.opcode == HALT) {
+            if (known[0]) {
+                *result = cells[0];
+                solved = true;
+            }
+            break;
+        }
+        if ((instr.opcode != ADD && instr.opcode != MULTIPLY) || ptr + 3 >= count) {
+            break;
+        }
+
+        // Null operands are unknown values; addresses read or written must be known in range.
+        Polynomial *operands[3];
+        bool valid = true;
+        for (int i = 0; i < 3 && valid; i++) {
+            long long paramIdx = ptr + 1 + i;
+            Polynomial *param = &cells[paramIdx];
+            long long address = param->coefficients[0][0];
+            if (!known[paramIdx]) {
+                valid = false;
+            } else if (instr.modes[i] == IMMEDIATE && i < 2) {
+                operands[i] = param;
+            } else if (instr.modes[i] != POSITION) {
+                valid = false;
+            } else if (poly_is_constant(param) && address >= 0 && address < count) {
+                operands[i] = (known[address] || i == 2) ? &cells[address] : 0;
+            } else if (i < 2) {
+                operands[i] = 0;
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            break;
+        }
+
+        long long destination = operands[2] - cells;
+        if (operands[0] == 0 || operands[1] == 0) {
+            known[destination] = false;
+        } else {
+            bool ok = (instr.opcode == ADD) ? poly_add(operands[2], operands[0], operands[1])
+                                            : poly_multiply(operands[2], operands[0], operands[1]);
+            if (!ok) {
+                break;
+            }
+            known[destination] = true;
+        }
+        ptr += 4;
+    }
+
+    free(cells);
+    free(known);
+    trace_info(TRACE_DAY, "Symbolic execution %s at address %lld.", solved ? "halted" : "gave up", ptr);
+    return solved;
+}
+
+// Fails if any step overflows, in which case the true value lies outside a long long and so can't
+// be the output sought.
+static bool poly_evaluate(Polynomial *p, long long noun, long long verb, long long *value) {
+    long long total = 0;
+    long long nounPower = 1;
+    for (int i = 0; i <= MAX_DEGREE; i++) {
+        if (i > 0 && __builtin_mul_overflow(nounPower, noun, &nounPower)) {
+            return false;
+        }
+        long long verbPower = 1;
+        for (int j = 0; j <= MAX_DEGREE; j++) {
+            long long term;
+            if ((j > 0 && __builtin_mul_overflow(verbPower, verb, &verbPower))
+                || __builtin_mul_overflow(p->coefficients[i][j], nounPower, &term)
+                || __builtin_mul_overflow(term, verbPower, &term)
+                || __builtin_add_overflow(total, term, &total)) {
+                return false;
+            }
+        }
+    }
+    *value = total;
+    return true;
+}
+
+// Finds the first noun/verb (in the order the search would try them) giving the output. When the
+// output is affine in the verb, each noun needs only a division; otherwise verbs are evaluated
+// arithmetically, which is still far cheaper than running the program.
+bool solveForOutput(Polynomial *p, long long output, int *noun, int *verb) {
+    bool affineInVerb = true;
+    for (int i = 0; i <= MAX_DEGREE; i++) {
+        for (int j = 2; j <= MAX_DEGREE; j++) {
+            affineInVerb = affineInVerb && p->coefficients[i][j] == 0;
+        }
     }
 
+    for (int nounGuess = 0; nounGuess < MAX_NOUN; nounGuess++) {
+        // output = constant + slope * verb for this noun. If either overflows, some verb might still
+        // fit, so they're all tried.
+        long long constant;
+        long long atOne;
+        long long slope;
+        if (affineInVerb && poly_evaluate(p, nounGuess, 0, &constant) && poly_evaluate(p, nounGuess, 1, &atOne)
+                && !__builtin_sub_overflow(atOne, constant, &slope)) {
+            if (slope == 0) {
+                if (constant == output) {
+                    *noun = nounGuess;
+                    *verb = 0;
+                    return true;
+                }
+                continue;
+            }
+            // A difference that overflows, or LLONG_MIN / -1, is far beyond any verb.
+            long long difference;
+            if (__builtin_sub_overflow(output, constant, &difference) || (slope == -1 && difference == LLONG_MIN)) {
+                continue;
+            }
+            if (difference % slope == 0 && difference / slope >= 0 && difference / slope < MAX_VERB) {
+                *noun = nounGuess;
+                *verb = (int)(difference / slope);
+                return true;
+            }
+            continue;
+        }
+
+        for (int verbGuess = 0; verbGuess < MAX_VERB; verbGuess++) {
+            long long value;
+            if (poly_evaluate(p, nounGuess, verbGuess, &value) && value == output) {
+                *noun = nounGuess;
+                *verb = verbGuess;
+                return true;
+            }
+        }
+    }
+
+    // Solved, but there's no answer; report it as the search would.
+    *noun = 1;
+    *verb = -1;
     return true;
 }
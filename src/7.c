@@ -1,415 +1,454 @@
 #include "7.h"
 
+#include "debug.h"
+
 #define TAPE_PATH "./inputs/7.txt"
-#define INITIAL_TAPE_LENGTH 50
 #define NUM_AMPLIFIERS 5
+#define CHANNEL_CAPACITY 64
+#define SIGNAL_CACHE_INITIAL_CAPACITY 256
 
-Tape *load_from_path(char *path) {
-    FILE *f = fopen(path, "r");
-    Tape *tape = tape_parse(f);
-    fclose(f);
-    return tape;
-}
-
+// Usage: 7 [-a amplifiers] [-t threads] [cooperative | pipeline | bench [rounds]]
+// Phase settings are searched on a pool of threads (one per core by default). The feedback loop
+// runs its amplifiers in turn on one thread unless 'pipeline' gives each amplifier its own thread;
+// 'bench' times the two against each other.
 int main(int argc, char **argv) {
-    int phaseSettings[NUM_AMPLIFIERS];
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        phaseSettings[i] = 0;
+    int amplifiers = NUM_AMPLIFIERS;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-a") == 0) {
+            amplifiers = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-t") == 0) {
+            threads = atoi(argv[arg + 1]);
+        }
+        arg += 2;
     }
+    if (amplifiers < 1 || amplifiers > MAX_AMPLIFIERS) {
+        fprintf(stderr, "ERROR: Amplifier count must be between 1 and %d.\n", MAX_AMPLIFIERS);
+        return 1;
+    }
+    threads = (threads < 1) ? 1 : (threads > MAX_SEARCH_THREADS) ? MAX_SEARCH_THREADS : threads;
 
-    int bestOutput = -1;
-    int bestFeedbackOutput = -1;
-    while (increment_phase_settings(phaseSettings)) {
-        if (phase_settings_are_valid(phaseSettings)) {
-            int thrusterSignal = get_thruster_signal(phaseSettings);
-            if (thrusterSignal > bestOutput) {
-                bestOutput = thrusterSignal;
-            }
+    Tape *tape = tape_load(TAPE_PATH);
+    State *initial = state_init(tape);
+    Snapshot *program = snapshot_take(initial);
+    state_free(initial);
+    tape_free(tape);
 
-            int feedbackSignal = get_thruster_signal_feedback(phaseSettings);
-            if (feedbackSignal > bestFeedbackOutput) {
-                bestFeedbackOutput = feedbackSignal;
-            }
-        }
+    if (arg < argc && strcmp(argv[arg], "bench") == 0) {
+        benchmark_feedback(program, amplifiers, threads, (arg + 1 < argc) ? atoi(argv[arg + 1]) : 20);
+        snapshot_free(program);
+        return 0;
     }
+    bool pipeline = (arg < argc && strcmp(argv[arg], "pipeline") == 0);
 
-    printf("The best possible thruster output is %d.\n", bestOutput);
-    printf("...but with feedback, it's %d.\n", bestFeedbackOutput);
+    long long bestFeedbackOutput;
+    long long bestOutput = search_phase_settings(program, amplifiers, threads, pipeline, &bestFeedbackOutput);
+    printf("The best possible thruster output is %lld.\n", bestOutput);
+    printf("...but with feedback, it's %lld.\n", bestFeedbackOutput);
+    snapshot_free(program);
 }
 
-bool increment_phase_settings(int *settings) {
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        settings[i] = (settings[i] + 1) % NUM_AMPLIFIERS;
-        if (settings[i] != 0) {
-            return true;
-        }
+long long factorial(int n) {
+    long long result = 1;
+    for (int i = 2; i <= n; i++) {
+        result *= i;
     }
-    return settings[NUM_AMPLIFIERS-1] != 0;
+    return result;
 }
 
-bool phase_settings_are_valid(int *settings) {
-    int indices[NUM_AMPLIFIERS];
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        indices[i] = 0;
-    }
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        indices[settings[i]]++;
+// Writes the rank'th permutation of 0..n-1 in lexicographic order, so that any range of ranks can
+// be handed to a worker without generating the permutations before it.
+void permutation_from_rank(long long rank, int n, int *permutation) {
+    int unused[MAX_AMPLIFIERS];
+    for (int i = 0; i < n; i++) {
+        unused[i] = i;
     }
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        if (indices[i] == 0) {
-            return false;
-        }
-    }
-    return true;
-}
 
-int get_thruster_signal(int *phaseSettings) {
-    Tape *tapes[NUM_AMPLIFIERS];
-    State *states[NUM_AMPLIFIERS];
-    int last_output = 0;
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        tapes[i] = load_from_path(TAPE_PATH);
-        states[i] = state_init(tapes[i]);
-        queue_append(states[i]->input, phaseSettings[i]);
-        queue_append(states[i]->input, last_output);
-        run_until_output(states[i]);
-        if (queue_is_empty(states[i]->output)) {
-            fprintf(stderr, "Amplifier %d exited without output.\n", i);
-        } else {
-            last_output = queue_retrieve(states[i]->output);
+    for (int i = 0; i < n; i++) {
+        long long block = factorial(n - 1 - i);
+        int choice = (int)(rank / block);
+        rank %= block;
+        permutation[i] = unused[choice];
+        for (int j = choice; j < n - 1 - i; j++) {
+            unused[j] = unused[j + 1];
         }
-        state_free(states[i]);
-        tape_free(tapes[i]);
     }
-
-    return last_output;
 }
 
-int get_thruster_signal_feedback(int *phaseSettings) {
-    Tape *tapes[NUM_AMPLIFIERS];
-    State *states[NUM_AMPLIFIERS];
-    int last_output = 0;
-    int last_system_output = 0;
-    int i = 0;
-
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        tapes[i] = load_from_path(TAPE_PATH);
-        states[i] = state_init(tapes[i]);
-        queue_append(states[i]->input, phaseSettings[i] + NUM_AMPLIFIERS);
+// Each worker starts with an equal share of the permutation ranks and takes them from the front of
+// its own range; once that's empty it steals the back half of the fullest remaining range.
+long long search_phase_settings(Snapshot *program, int amplifiers, int threads, bool pipeline,
+                                long long *bestFeedback) {
+    long long total = factorial(amplifiers);
+    if (threads > total) {
+        threads = (int)total;
     }
 
-    while (1) {
-        queue_append(states[i]->input, last_output);
-        run_until_output(states[i]);
-        if (queue_is_empty(states[i]->output)) {
-            break;
-        } else {
-            last_output = queue_retrieve(states[i]->output);
-            if (i == NUM_AMPLIFIERS - 1) {
-                last_system_output = last_output;
-            }
-        }
-
-        i = (i + 1) % NUM_AMPLIFIERS;
+    PhaseSearch search;
+    search.program = program;
+    search.amplifiers = amplifiers;
+    search.pipeline = pipeline;
+    search.workerCount = threads;
+    SearchWorker workers[MAX_SEARCH_THREADS];
+    pthread_t handles[MAX_SEARCH_THREADS];
+    search.workers = workers;
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&workers[i].lock, 0);
+        workers[i].search = &search;
+        workers[i].next = total * i / threads;
+        workers[i].end = total * (i + 1) / threads;
+        workers[i].best = -1;
+        workers[i].bestFeedback = -1;
+        signal_cache_init(&workers[i].cache);
     }
 
-    for (int i = 0; i < NUM_AMPLIFIERS; i++) {
-        state_free(states[i]);
-        tape_free(tapes[i]);
+    // The calling thread works too, as worker 0.
+    int started = 1;
+    while (started < threads && pthread_create(&handles[started], 0, search_worker, &workers[started]) == 0) {
+        started++;
     }
-
-    return last_system_output;
-}
-
-void run_until_output(State *state) {
-    while(is_running(state) && queue_is_empty(state->output)) {
-        tick(state);
+    if (started < threads) {
+        fprintf(stderr, "ERROR: Could only start %d of %d search threads.\n", started, threads);
     }
-
-    if (state->status == ERROR) {
-        fprintf(stderr, "ERROR: program %p exited with status ERROR.\n", state);
-	}
+    search_worker(&workers[0]);
+
+    long long best = -1;
+    *bestFeedback = -1;
+    for (int i = 0; i < threads; i++) {
+        if (i > 0 && i < started) {
+            pthread_join(handles[i], 0);
+        } else if (i > 0) {
+            search_worker(&workers[i]); // Anything its thread would have stolen is long gone.
+        }
+        best = (workers[i].best > best) ? workers[i].best : best;
+        *bestFeedback = (workers[i].bestFeedback > *bestFeedback) ? workers[i].bestFeedback : *bestFeedback;
+        trace_info(TRACE_DAY, "Search worker %d ran %lld amplifiers for the plain chain.", i, workers[i].cache.runs);
+        signal_cache_free(&workers[i].cache);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    return best;
 }
 
-void tick(State *state) {
-    Instruction instr = read_instruction(state);
-    Opcode opcode = get_opcode(instr);
-    switch (opcode) {
-        case ADD:
-            do_add(state, instr);
-            break;
-        case MULTIPLY:
-            do_multiply(state, instr);
-            break;
-        case INPUT:
-            do_input(state, instr);
-            break;
-        case OUTPUT:
-            do_output(state, instr);
-            break;
-        case JUMP_IF_TRUE:
-            do_jump_if_true(state, instr);
-            break;
-        case JUMP_IF_FALSE:
-            do_jump_if_false(state, instr);
-            break;
-        case LESS_THAN:
-            do_less_than(state, instr);
-            break;
-        case EQUALS:
-            do_equals(state, instr);
-            break;
-        case HALT:
-            do_halt(state, instr);
-            break;
-        default:
-            fprintf(stderr, "ERROR: Unknown opcode %d encountered in instruction %d at address %d.\n", opcode, instr, state->ptr);
-            state->status = ERROR;
+// Claims the next rank for a worker, stealing if its own range is empty. Returns -1 when there's
+// no work left anywhere.
+long long take_rank(SearchWorker *worker) {
+    pthread_mutex_lock(&worker->lock);
+    if (worker->next < worker->end) {
+        long long rank = worker->next++;
+        pthread_mutex_unlock(&worker->lock);
+        return rank;
     }
-}
+    pthread_mutex_unlock(&worker->lock);
 
-Instruction read_instruction(State *state) {
-    return read_next_value(state);
-}
+    PhaseSearch *search = worker->search;
+    while (1) {
+        SearchWorker *victim = 0;
+        long long most = 0;
+        for (int i = 0; i < search->workerCount; i++) {
+            SearchWorker *other = &search->workers[i];
+            pthread_mutex_lock(&other->lock);
+            long long remaining = other->end - other->next;
+            pthread_mutex_unlock(&other->lock);
+            if (other != worker && remaining > most) {
+                victim = other;
+                most = remaining;
+            }
+        }
+        if (victim == 0) {
+            return -1;
+        }
 
-Opcode get_opcode(Instruction instr) {
-    // The opcode is made up of the last two digits of the instruction.
-    return instr % 100;
+        // Keep the first stolen rank and put the rest in our own range for others to steal.
+        pthread_mutex_lock(&victim->lock);
+        long long remaining = victim->end - victim->next;
+        if (remaining <= 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        long long start = victim->end - (remaining + 1) / 2;
+        long long end = victim->end;
+        victim->end = start;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&worker->lock);
+        worker->next = start + 1;
+        worker->end = end;
+        pthread_mutex_unlock(&worker->lock);
+        return start;
+    }
 }
 
-void do_add(State *state, Instruction instr) {
-    int a = load_parameter(state, instr, 1);
-    int b = load_parameter(state, instr, 2);
-    int dst = load_destination(state, instr, 3);
-    update_or_error(state, dst, a + b);
-}
+void *search_worker(void *context) {
+    SearchWorker *worker = context;
+    PhaseSearch *search = worker->search;
+    int phaseSettings[MAX_AMPLIFIERS];
+    long long rank;
+    while ((rank = take_rank(worker)) >= 0) {
+        permutation_from_rank(rank, search->amplifiers, phaseSettings);
+        long long thrusterSignal = get_thruster_signal_cached(search->program, phaseSettings,
+                                                              search->amplifiers, &worker->cache);
+        if (thrusterSignal > worker->best) {
+            worker->best = thrusterSignal;
+        }
 
-void do_multiply(State *state, Instruction instr) {
-    int a = load_parameter(state, instr, 1);
-    int b = load_parameter(state, instr, 2);
-    int dst = load_destination(state, instr, 3);
-    update_or_error(state, dst, a * b);
+        long long feedbackSignal = search->pipeline
+            ? get_thruster_signal_pipeline(search->program, phaseSettings, search->amplifiers)
+            : get_thruster_signal_feedback(search->program, phaseSettings, search->amplifiers);
+        if (feedbackSignal > worker->bestFeedback) {
+            worker->bestFeedback = feedbackSignal;
+        }
+    }
+    return 0;
 }
 
-void do_input(State *state, Instruction instr) {
-    int dst = load_destination(state, instr, 1);
-    if (queue_is_empty(state->input)) {
-        fprintf(stderr, "Input requested, but input queue is empty!\n");
-        state->status = ERROR;
-        return;
+long long get_thruster_signal(Snapshot *program, int *phaseSettings, int amplifiers) {
+    long long last_output = 0;
+    for (int i = 0; i < amplifiers; i++) {
+        last_output = run_amplifier_once(program, i, phaseSettings[i], last_output);
     }
-
-    int value = queue_retrieve(state->input);
-    update_or_error(state, dst, value);
+    return last_output;
 }
 
-void do_output(State *state, Instruction instr) {
-    int value = load_parameter(state, instr, 1);
-    queue_append(state->output, value);
-}
+// Runs one amplifier of the plain chain; an amplifier that produces nothing passes its input on.
+long long run_amplifier_once(Snapshot *program, int position, int phase, long long input) {
+    State *state = snapshot_restore(program);
+    Queue *inputs = queue_init();
+    Queue *outputs = queue_init();
+    state_use_queues(state, inputs, outputs);
+    queue_append(inputs, phase);
+    queue_append(inputs, input);
+    run_until_output(state);
 
-void do_jump_if_true(State *state, Instruction instr) {
-    int conditional = load_parameter(state, instr, 1);
-    int new_ptr = load_parameter(state, instr, 2);
-    if (conditional != 0) {
-        state->ptr = new_ptr;
+    long long output = input;
+    if (queue_is_empty(outputs)) {
+        fprintf(stderr, "Amplifier %d exited without output.\n", position);
+    } else {
+        output = queue_retrieve(outputs);
+    }
+    tape_free(state->tape);
+    state_free(state);
+    queue_free(inputs);
+    queue_free(outputs);
+    return output;
+}
+
+// As get_thruster_signal, but reusing earlier work. Permutations come in lexicographic order, which
+// walks the trie of phase prefixes depth first, so only the path to the previous permutation needs
+// keeping: everything it shares with this one is already known. Below that, each (position, phase,
+// input signal) is looked up in a table before an amplifier is run.
+long long get_thruster_signal_cached(Snapshot *program, int *phaseSettings, int amplifiers,
+                                     SignalCache *cache) {
+    int shared = 0;
+    while (shared < cache->prefixLength && phaseSettings[shared] == cache->prefixPhases[shared]) {
+        shared++;
     }
-}
 
-void do_jump_if_false(State *state, Instruction instr) {
-    int conditional = load_parameter(state, instr, 1);
-    int new_ptr = load_parameter(state, instr, 2);
-    if (conditional == 0) {
-        state->ptr = new_ptr;
+    long long signal = (shared > 0) ? cache->prefixSignals[shared - 1] : 0;
+    for (int i = shared; i < amplifiers; i++) {
+        signal = signal_cache_lookup(program, cache, i, phaseSettings[i], signal);
+        cache->prefixPhases[i] = phaseSettings[i];
+        cache->prefixSignals[i] = signal;
     }
+    cache->prefixLength = amplifiers;
+    return signal;
 }
 
-void do_less_than(State *state, Instruction instr) {
-    int a = load_parameter(state, instr, 1);
-    int b = load_parameter(state, instr, 2);
-    int dst = load_destination(state, instr, 3);
-    int result = (a < b) ? 1 : 0;
-    update_or_error(state, dst, result);
+void signal_cache_init(SignalCache *cache) {
+    cache->capacity = SIGNAL_CACHE_INITIAL_CAPACITY;
+    cache->count = 0;
+    cache->entries = calloc(cache->capacity, sizeof(CachedSignal));
+    cache->prefixLength = 0;
+    cache->runs = 0;
 }
 
-void do_equals(State *state, Instruction instr) {
-    int a = load_parameter(state, instr, 1);
-    int b = load_parameter(state, instr, 2);
-    int dst = load_destination(state, instr, 3);
-    int result = (a == b) ? 1 : 0;
-    update_or_error(state, dst, result);
+void signal_cache_free(SignalCache *cache) {
+    free(cache->entries);
 }
 
-void do_halt(State *state, Instruction instr) {
-    state->status = COMPLETE;
+static unsigned long long signal_hash(int position, int phase, long long input) {
+    unsigned long long hash = (unsigned long long)input * 0x9E3779B97F4A7C15ULL;
+    hash ^= ((unsigned long long)position << 8 | (unsigned long long)phase) * 0xC2B2AE3D27D4EB4FULL;
+    return hash ^ (hash >> 29);
 }
 
-int load_parameter(State *state, Instruction instr, int paramIdx) {
-    int rawParam = read_next_value(state);
-    AddressMode addressMode = get_parameter_address_mode(instr, paramIdx);
-    switch (addressMode) {
-        case POSITION:
-            // In POSITION mode, the tape value is a pointer to the location holding the parameter.
-            return tape_get(state->tape, rawParam);
-        case IMMEDIATE:
-            // In IMMEDIATE mode, the tape value is a literal.
-            return rawParam;
-        default:
-            fprintf(stderr, "ERROR: Unknown address mode %d.\n", addressMode);
-            state->status = ERROR;
-            return 0;
+// Open addressing with linear probing, doubling whenever the table is half full.
+long long signal_cache_lookup(Snapshot *program, SignalCache *cache, int position, int phase, long long input) {
+    unsigned long long mask = cache->capacity - 1;
+    unsigned long long slot = signal_hash(position, phase, input) & mask;
+    while (cache->entries[slot].used) {
+        CachedSignal *entry = &cache->entries[slot];
+        if (entry->position == position && entry->phase == phase && entry->input == input) {
+            return entry->output;
+        }
+        slot = (slot + 1) & mask;
     }
-}
 
-int load_destination(State *state, Instruction instr, int paramIdx) {
-    int destination = read_next_value(state);
-    AddressMode addressMode = get_parameter_address_mode(instr, paramIdx);
-    if (addressMode != POSITION) {
-        fprintf(stderr, "ERROR: A destination parameter had invalid address mode %d."
-                        " Destinations must have POSITION mode.\n", addressMode);
-        state->status = ERROR;
+    long long output = run_amplifier_once(program, position, phase, input);
+    cache->runs++;
+    if ((cache->count + 1) * 2 > cache->capacity) {
+        signal_cache_grow(cache);
+        mask = cache->capacity - 1;
+        slot = signal_hash(position, phase, input) & mask;
+        while (cache->entries[slot].used) {
+            slot = (slot + 1) & mask;
+        }
     }
-    return destination;
-}
 
-AddressMode get_parameter_address_mode(Instruction instr, int paramIdx) {
-    // The address mode for parameter 'i' is the digit with offset (i+2) from the right of the instruction.
-    instr /= 100;
-    for (int i = 1; i < paramIdx; i++) {
-        instr /= 10;
+    CachedSignal *entry = &cache->entries[slot];
+    entry->used = true;
+    entry->position = position;
+    entry->phase = phase;
+    entry->input = input;
+    entry->output = output;
+    cache->count++;
+    return output;
+}
+
+void signal_cache_grow(SignalCache *cache) {
+    CachedSignal *old = cache->entries;
+    long long oldCapacity = cache->capacity;
+    cache->capacity *= 2;
+    cache->entries = calloc(cache->capacity, sizeof(CachedSignal));
+
+    unsigned long long mask = cache->capacity - 1;
+    for (long long i = 0; i < oldCapacity; i++) {
+        if (old[i].used) {
+            unsigned long long slot = signal_hash(old[i].position, old[i].phase, old[i].input) & mask;
+            while (cache->entries[slot].used) {
+                slot = (slot + 1) & mask;
+            }
+            cache->entries[slot] = old[i];
+        }
     }
-    return instr % 10;
+    free(old);
 }
 
-int read_next_value(State *state) {
-    int value = tape_get(state->tape, state->ptr);
-    advance_pointer(state, 1);
-    return value;
-}
+// Feedback runs use phase settings offset by the amplifier count (5-9 for the usual five).
+long long get_thruster_signal_feedback(Snapshot *program, int *phaseSettings, int amplifiers) {
+    State *states[MAX_AMPLIFIERS];
+    Queue *inputs[MAX_AMPLIFIERS];
+    Queue *outputs[MAX_AMPLIFIERS];
+    long long last_output = 0;
+    long long last_system_output = 0;
+    int i = 0;
 
-void update_or_error(State *state, int dest, int value) {
-    if (!tape_update(state->tape, dest, value)) {
-        fprintf(stderr, "ERROR: failed to update the tape.\n");
-        state->status = ERROR;
+    for (int i = 0; i < amplifiers; i++) {
+        states[i] = snapshot_restore(program);
+        inputs[i] = queue_init();
+        outputs[i] = queue_init();
+        state_use_queues(states[i], inputs[i], outputs[i]);
+        queue_append(inputs[i], phaseSettings[i] + amplifiers);
     }
-}
-
-void advance_pointer(State *state, int offset) {
-    state->ptr += offset;
-}
-
-State *state_init(Tape *tape) {
-    State *state = malloc(sizeof(State));
-    state->tape = tape;
-    state->ptr = 0;
-    state->status = RUNNING;
-    state->input = queue_init();
-    state->output = queue_init();
-    return state;
-}
-
-void state_free(State *state) {
-    queue_free(state->input);
-    queue_free(state->output);
-    free(state);
-}
 
-bool is_running(State *state) {
-    return state->status == RUNNING;
-}
-
-Tape *tape_parse(FILE *f) {
-    Tape *tape = tape_init();
-    int value;
     while (1) {
-        int read = fscanf(f, "%d,", &value);
-        if (read <= 0) {
+        queue_append(inputs[i], last_output);
+        run_until_output(states[i]);
+        if (queue_is_empty(outputs[i])) {
             break;
+        } else {
+            last_output = queue_retrieve(outputs[i]);
+            if (i == amplifiers - 1) {
+                last_system_output = last_output;
+            }
         }
-        tape_append(tape, value);
-    }
-    return tape;
-}
-
-Tape *tape_init() {
-    Tape *tape = malloc(sizeof(Tape));
-    tape->capacity = INITIAL_TAPE_LENGTH;
-    tape->values = malloc(sizeof(int) * tape->capacity);
-    tape->count = 0;
-    return tape;
-}
 
-void tape_free(Tape *tape) {
-    free(tape->values);
-    free(tape);
-}
+        i = (i + 1) % amplifiers;
+    }
 
-void tape_append(Tape *tape, int value) {
-    if (tape->count * 2 > tape->capacity) {
-        tape->capacity *= 2;
-        tape->values = realloc(tape->values, sizeof(int) * tape->capacity);
+    for (int i = 0; i < amplifiers; i++) {
+        tape_free(states[i]->tape);
+        state_free(states[i]);
+        queue_free(inputs[i]);
+        queue_free(outputs[i]);
     }
 
-    tape->values[tape->count++] = value;
+    return last_system_output;
 }
 
-int tape_get(Tape *tape, int idx) {
-    if (idx < 0) {
-        fprintf(stderr, "ERROR: Attempt to read negative index %d from tape.\n", idx);
-        return 0;
-    } else if (idx >= tape->count) {
-        fprintf(stderr, "ERROR: Attempt to read after end of tape (index %d, tape end %d).\n", idx, tape->count);
-        return 0;
-    } else {
-        return tape->values[idx];
+// Runs each amplifier on its own thread, linked by channels, so the feedback loop behaves as a
+// pipeline. The last amplifier's output passes through this thread on its way back to the first,
+// which is how the final thruster signal is seen.
+long long get_thruster_signal_pipeline(Snapshot *program, int *phaseSettings, int amplifiers) {
+    State *states[MAX_AMPLIFIERS];
+    Channel *inputs[MAX_AMPLIFIERS];
+    Channel *thrusters = channel_init(CHANNEL_CAPACITY);
+    pthread_t threads[MAX_AMPLIFIERS];
+
+    for (int i = 0; i < amplifiers; i++) {
+        inputs[i] = channel_init(CHANNEL_CAPACITY);
+        channel_send(inputs[i], phaseSettings[i] + amplifiers);
+        if (i == 0) {
+            channel_send(inputs[i], 0); // The first amplifier's first signal.
+        }
     }
-}
 
-bool tape_update(Tape *tape, int idx, int value) {
-    if (idx >= tape->count) {
-        fprintf(stderr, "ERROR: Attempt to update value after end of tape (index %d, tape end %d).\n", idx, tape->count);
-        return false;
+    int started = 0;
+    for (int i = 0; i < amplifiers; i++) {
+        states[i] = snapshot_restore(program);
+        state_use_channels(states[i], inputs[i], (i == amplifiers - 1) ? thrusters : inputs[i + 1]);
+        if (pthread_create(&threads[i], 0, run_amplifier, states[i]) != 0) {
+            // Starve the amplifiers already running so that they stop with an error.
+            fprintf(stderr, "ERROR: Could not start a thread for amplifier %d.\n", i);
+            for (int j = 0; j < amplifiers; j++) {
+                channel_close(inputs[j]);
+            }
+            channel_close(thrusters);
+            break;
+        }
+        started++;
     }
 
-    tape->values[idx] = value;
-    return true;
-}
-
-Queue *queue_init() {
-    Queue *queue = malloc(sizeof(Queue));
-    queue->start = 0;
-    return queue;
-}
-
-void queue_free(Queue *queue) {
-    struct s_QueueCell *cell = queue->start;
-    while (cell != 0) {
-        struct s_QueueCell *next = cell->next;
-        free(cell);
-        cell = next;
+    // Every amplifier closes its output as it stops, so this ends once the last one has halted.
+    // The first amplifier has already halted when the final signal arrives, which leaves that
+    // signal unread in its input channel.
+    long long last_system_output = 0;
+    long long value;
+    while (channel_receive(thrusters, &value)) {
+        last_system_output = value;
+        channel_send(inputs[0], value);
     }
-    free(queue);
-}
-
-int queue_retrieve(Queue *queue) {
-    struct s_QueueCell *head = queue->start;
-    queue->start = head->next;
-    int result = head->value;
-    free(head);
-    return result;
-}
+    channel_close(inputs[0]);
 
-void queue_append(Queue *queue, int value) {
-    struct s_QueueCell **ptrToNext = &queue->start;
-    while (*ptrToNext != 0) {
-        ptrToNext = &(*ptrToNext)->next;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], 0);
+    }
+    for (int i = 0; i < amplifiers; i++) {
+        if (i <= started) {
+            tape_free(states[i]->tape);
+            state_free(states[i]);
+        }
+        channel_free(inputs[i]);
     }
+    channel_free(thrusters);
 
-    *ptrToNext = malloc(sizeof(struct s_QueueCell));
-    (*ptrToNext)->value = value;
-    (*ptrToNext)->next = 0;
+    return last_system_output;
 }
 
-bool queue_is_empty(Queue *queue) {
-    return queue->start == 0;
+void *run_amplifier(void *context) {
+    State *state = context;
+    run(state);
+    channel_close(state->channels.output);
+    return 0;
+}
+
+// Compares the feedback search run cooperatively and pipelined on one search thread, and run
+// cooperatively across the whole pool.
+void benchmark_feedback(Snapshot *program, int amplifiers, int threads, int rounds) {
+    const char *names[3] = { "Cooperative", "Pipeline", "Parallel search" };
+    int searchThreads[3] = { 1, 1, threads };
+    long long permutations = factorial(amplifiers);
+    for (int mode = 0; mode < 3; mode++) {
+        struct timespec start, end;
+        long long best = -1;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < rounds; i++) {
+            search_phase_settings(program, amplifiers, searchThreads[mode], mode == 1, &best);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%s (%d threads): %d rounds of %lld permutations in %.3fs (%.0f permutations/s). Best feedback signal %lld.\n",
+               names[mode], searchThreads[mode], rounds, permutations, seconds, rounds * permutations / seconds, best);
+    }
 }
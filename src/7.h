@@ -1,86 +1,67 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdbool.h>
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "intcode.h"
 
-typedef struct {
-    int *values;
-    int count;
-    int capacity;
-} Tape;
-
-Tape *tape_init();
-void tape_free(Tape *);
-Tape *tape_parse(FILE *);
-void tape_append(Tape *, int);
-int tape_get(Tape *, int);
-bool tape_update(Tape *tape, int idx, int value);
+#define MAX_AMPLIFIERS 10
+#define MAX_SEARCH_THREADS 64
 
-struct s_QueueCell {
-    int value;
-    struct s_QueueCell *next;
-};
+typedef struct s_PhaseSearch PhaseSearch;
 
 typedef struct {
-    struct s_QueueCell *start;
-} Queue;
-
-Queue *queue_init();
-void queue_free(Queue *);
-int queue_retrieve(Queue *);
-void queue_append(Queue *, int);
-bool queue_is_empty(Queue *);
-
-typedef enum { POSITION, IMMEDIATE } AddressMode;
+    bool used;
+    int position;
+    int phase;
+    long long input;
+    long long output;
+} CachedSignal;
 
-typedef int Instruction;
-
-typedef enum {
-    ADD = 1,
-    MULTIPLY = 2,
-    INPUT = 3,
-    OUTPUT = 4,
-    JUMP_IF_TRUE = 5,
-    JUMP_IF_FALSE = 6,
-    LESS_THAN = 7,
-    EQUALS = 8,
-    HALT = 99
-} Opcode;
-
-Opcode get_opcode(Instruction instruction);
-AddressMode get_parameter_address_mode(Instruction instruction, int paramIndex);
-
-typedef enum { RUNNING, COMPLETE, ERROR } Status;
+// Per-worker memory of plain-chain amplifier results; see get_thruster_signal_cached.
+typedef struct {
+    CachedSignal *entries;
+    long long capacity; // A power of two.
+    long long count;
+    int prefixPhases[MAX_AMPLIFIERS]; // The previous permutation...
+    long long prefixSignals[MAX_AMPLIFIERS]; // ...and the signal after each of its amplifiers.
+    int prefixLength;
+    long long runs; // Amplifiers actually run.
+} SignalCache;
 
+// One thread of a phase setting search, owning the permutation ranks [next, end).
 typedef struct {
-    Tape *tape;
-    int ptr;
-    Status status;
-    Queue *input;
-    Queue *output;
-} State;
+    pthread_mutex_t lock;
+    PhaseSearch *search;
+    long long next;
+    long long end;
+    long long best;
+    long long bestFeedback;
+    SignalCache cache;
+} SearchWorker;
 
-State *state_init(Tape *);
-void state_free(State *); // This must *not* free the tape!
-bool is_running(State *);
-int read_next_value(State *);
-void advance_pointer(State *, int);
-Instruction read_instruction(State *);
-int load_parameter(State *state, Instruction instr, int paramIdx);
-int load_destination(State *state, Instruction instr, int paramIdx);
-void do_add(State *, Instruction);
-void do_multiply(State *, Instruction);
-void do_input(State *, Instruction);
-void do_output(State *, Instruction);
-void do_jump_if_true(State *, Instruction);
-void do_jump_if_false(State *, Instruction);
-void do_less_than(State *, Instruction);
-void do_equals(State *, Instruction);
-void do_halt(State *, Instruction);
-void update_or_error(State *state, int dest, int value);
-void tick(State *);
-void run_until_output(State *);
+struct s_PhaseSearch {
+    Snapshot *program;
+    int amplifiers;
+    bool pipeline;
+    SearchWorker *workers;
+    int workerCount;
+};
 
-int get_thruster_signal(int* phaseSettings);
-int get_thruster_signal_feedback(int* phaseSettings);
-bool phase_settings_are_valid(int* phaseSettings);
-bool increment_phase_settings(int* phaseSettings);
+long long get_thruster_signal(Snapshot *program, int* phaseSettings, int amplifiers);
+long long get_thruster_signal_cached(Snapshot *program, int* phaseSettings, int amplifiers, SignalCache *);
+long long run_amplifier_once(Snapshot *program, int position, int phase, long long input);
+void signal_cache_init(SignalCache *);
+void signal_cache_free(SignalCache *);
+long long signal_cache_lookup(Snapshot *program, SignalCache *, int position, int phase, long long input);
+void signal_cache_grow(SignalCache *);
+long long get_thruster_signal_feedback(Snapshot *program, int* phaseSettings, int amplifiers);
+long long get_thruster_signal_pipeline(Snapshot *program, int* phaseSettings, int amplifiers);
+long long factorial(int);
+void permutation_from_rank(long long rank, int n, int *permutation);
+long long search_phase_settings(Snapshot *program, int amplifiers, int threads, bool pipeline,
+                                long long *bestFeedback);
+long long take_rank(SearchWorker *);
+void *search_worker(void *);
+void benchmark_feedback(Snapshot *program, int amplifiers, int threads, int rounds);
+void *run_amplifier(void *state);
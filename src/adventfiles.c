@@ -1,23 +1,124 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "adventfiles.h"
 
+#define STREAM_BUFFER_SIZE 65536
+
+typedef struct {
+    adv_line_handler handleLine;
+    void *context;
+    char *line;
+    size_t capacity;
+} LineCopier;
+
+static void copy_line(const char *line, size_t length, void *context);
+static void for_line_in_span(const char *data, size_t length, adv_line_span_handler handleLine, void *context);
+
 void adv_forLineInFile(char *path, adv_line_handler handleLine, void *context) {
-    FILE *f = fopen(path, "r");
-    char line[10000];
+    LineCopier copier = { handleLine, context, 0, 0 };
+    adv_forLineSpanInFile(path, copy_line, &copier);
+    free(copier.line);
+}
+
+static void copy_line(const char *line, size_t length, void *context) {
+    LineCopier *copier = context;
+    if (length + 1 > copier->capacity) {
+        copier->capacity = length + 1;
+        copier->line = realloc(copier->line, copier->capacity);
+    }
+    memcpy(copier->line, line, length);
+    copier->line[length] = '\0';
+    copier->handleLine(copier->line, copier->context);
+}
+
+bool adv_forLineSpanInFile(const char *path, adv_line_span_handler handleLine, void *context) {
+    if (strcmp(path, "-") == 0) {
+        return adv_forLineSpanInStream(STDIN_FILENO, handleLine, context);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Could not open %s: %s.\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            for_line_in_span(data, info.st_size, handleLine, context);
+            munmap(data, info.st_size);
+            close(fd);
+            return true;
+        }
+    }
+
+    bool streamed = adv_forLineSpanInStream(fd, handleLine, context);
+    close(fd);
+    return streamed;
+}
+
+bool adv_forLineSpanInStream(int fd, adv_line_span_handler handleLine, void *context) {
+    size_t capacity = STREAM_BUFFER_SIZE;
+    char *buffer = malloc(capacity);
+    size_t start = 0; // First byte of the line in progress.
+    size_t scanned = 0; // Bytes already searched for a newline.
+    size_t end = 0;
+    bool readOk = true;
     while (1) {
-        char *s = fgets(line, 10000, f);
-        if (s == 0) {
+        if (end == capacity) {
+            if (start > 0) {
+                memmove(buffer, buffer + start, end - start);
+                end -= start;
+                scanned -= start;
+                start = 0;
+            } else {
+                capacity *= 2;
+                buffer = realloc(buffer, capacity);
+            }
+        }
+
+        ssize_t count = read(fd, buffer + end, capacity - end);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0) {
+            fprintf(stderr, "ERROR: Could not read input: %s.\n", strerror(errno));
+            readOk = false;
+            break;
+        } else if (count == 0) {
             break;
         }
+        end += count;
 
-        char *trimmed = strtok(line, "\n");
-        if (trimmed[0] == '\n') {
-            handleLine("", context);
-        } else {
-            handleLine(trimmed, context);
+        char *newline;
+        while ((newline = memchr(buffer + scanned, '\n', end - scanned)) != 0) {
+            size_t lineEnd = newline - buffer;
+            handleLine(buffer + start, lineEnd - start, context);
+            start = lineEnd + 1;
+            scanned = start;
         }
+        scanned = end;
     }
 
-    fclose(f);
+    if (readOk && start < end) {
+        handleLine(buffer + start, end - start, context);
+    }
+    free(buffer);
+    return readOk;
 }
 
-
+// A final line without a newline still counts; the empty "line" after a final newline doesn't.
+static void for_line_in_span(const char *data, size_t length, adv_line_span_handler handleLine, void *context) {
+    const char *end = data + length;
+    while (data < end) {
+        const char *newline = memchr(data, '\n', end - data);
+        const char *lineEnd = (newline != 0) ? newline : end;
+        handleLine(data, lineEnd - data, context);
+        data = lineEnd + 1;
+    }
+}
@@ -1,7 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 
 typedef void (*adv_line_handler) (char *line, void *context);
 
+// Lines are handed over as a view of length bytes, without the newline and not NUL-terminated. A
+// view is only valid during the call.
+typedef void (*adv_line_span_handler) (const char *line, size_t length, void *context);
+
+// Calls handleLine with each line, as a NUL-terminated copy the handler may modify.
 void adv_forLineInFile(char *path, adv_line_handler handleLine, void *context);
+
+// Zero-copy iteration: a regular file is mapped into memory and lines are views into the mapping,
+// however long they are. Anything that can't be mapped (a pipe, or "-" for stdin) is streamed
+// through a buffer that grows to fit the longest line. Returns false if the file can't be read.
+bool adv_forLineSpanInFile(const char *path, adv_line_span_handler handleLine, void *context);
+bool adv_forLineSpanInStream(int fd, adv_line_span_handler handleLine, void *context);
@@ -0,0 +1,203 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Times each day's solver over repeated runs and records the results.
+// Usage: day-bench [-n runs] [-o results.tsv] [-l label] [-d directory] day...
+// Every day runs as <directory>/<day> (build/<day> by default) with stdin and stdout discarded. Results are printed as a table and,
+// with -o, appended to a tab-separated file (one line per day, tagged with the label) that can be
+// compared across revisions. Intcode days also report how many instructions they executed.
+
+#define MAX_RUNS 10000
+#define MAX_ARGS 8
+
+// Days whose solvers would otherwise prompt for input.
+typedef struct {
+    const char *day;
+    const char *args[MAX_ARGS];
+} DayArguments;
+
+static const DayArguments DAY_ARGUMENTS[] = {
+    { "5", { "5" } },
+    { "9", { "2" } },
+};
+
+typedef struct {
+    double seconds[MAX_RUNS];
+    long peakRssKb;
+    long long instructions;
+} DayResults;
+
+bool run_day(const char *directory, const char *day, const char *statsPath, double *seconds, long *rssKb, long long *instructions);
+const char *const *arguments_for(const char *day);
+int compare_doubles(const void *a, const void *b);
+double percentile(double *sorted, int count, double p);
+
+int main(int argc, char **argv) {
+    int runs = 10;
+    const char *resultsPath = 0;
+    const char *label = "-";
+    const char *directory = "build";
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-n") == 0) {
+            runs = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-o") == 0) {
+            resultsPath = argv[arg + 1];
+        } else if (strcmp(argv[arg], "-l") == 0) {
+            label = argv[arg + 1];
+        } else if (strcmp(argv[arg], "-d") == 0) {
+            directory = argv[arg + 1];
+        }
+        arg += 2;
+    }
+    if (runs < 1 || runs > MAX_RUNS) {
+        fprintf(stderr, "ERROR: Runs must be between 1 and %d.\n", MAX_RUNS);
+        return 1;
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "Usage: %s [-n runs] [-o results.tsv] [-l label] [-d directory] day...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *results = 0;
+    if (resultsPath != 0) {
+        bool exists = access(resultsPath, F_OK) == 0;
+        results = fopen(resultsPath, "a");
+        if (results == 0) {
+            fprintf(stderr, "ERROR: Could not open %s: %s.\n", resultsPath, strerror(errno));
+            return 1;
+        }
+        if (!exists) {
+            fprintf(results, "label\tday\truns\tmin_ms\tmedian_ms\tp99_ms\tpeak_rss_kb\tinstructions\n");
+        }
+    }
+
+    char statsPath[] = "/tmp/day-bench-XXXXXX";
+    int statsFd = mkstemp(statsPath);
+    if (statsFd < 0) {
+        fprintf(stderr, "ERROR: Could not create a file for instruction counts: %s.\n", strerror(errno));
+        return 1;
+    }
+    close(statsFd);
+
+    int failures = 0;
+    static DayResults day;
+    printf("%-6s %6s %12s %12s %12s %12s %16s\n", "Day", "Runs", "Min ms", "Median ms", "p99 ms", "Peak RSS KB",
+           "Instructions");
+    for (; arg < argc; arg++) {
+        day.peakRssKb = 0;
+        day.instructions = 0;
+        bool ok = true;
+        for (int i = 0; i < runs && ok; i++) {
+            long rssKb;
+            ok = run_day(directory, argv[arg], statsPath, &day.seconds[i], &rssKb, &day.instructions);
+            day.peakRssKb = (rssKb > day.peakRssKb) ? rssKb : day.peakRssKb;
+        }
+        if (!ok) {
+            failures++;
+            continue;
+        }
+
+        qsort(day.seconds, runs, sizeof(double), compare_doubles);
+        double min = day.seconds[0] * 1e3;
+        double median = percentile(day.seconds, runs, 0.5) * 1e3;
+        double p99 = percentile(day.seconds, runs, 0.99) * 1e3;
+        printf("%-6s %6d %12.3f %12.3f %12.3f %12ld %16lld\n", argv[arg], runs, min, median, p99, day.peakRssKb,
+               day.instructions);
+        if (results != 0) {
+            fprintf(results, "%s\t%s\t%d\t%.3f\t%.3f\t%.3f\t%ld\t%lld\n", label, argv[arg], runs, min, median, p99,
+                    day.peakRssKb, day.instructions);
+        }
+    }
+
+    unlink(statsPath);
+    if (results != 0) {
+        fclose(results);
+    }
+    return (failures > 0) ? 1 : 0;
+}
+
+// Runs <directory>/<day> once, returning its wall time, peak RSS and Intcode instruction count.
+bool run_day(const char *directory, const char *day, const char *statsPath, double *seconds, long *rssKb, long long *instructions) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", directory, day);
+    const char *args[MAX_ARGS + 2] = { path };
+    const char *const *dayArgs = arguments_for(day);
+    for (int i = 0; dayArgs != 0 && i < MAX_ARGS && dayArgs[i] != 0; i++) {
+        args[i + 1] = dayArgs[i];
+    }
+
+    unlink(statsPath); // So a day that dies early can't report the last one's count.
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t child = fork();
+    if (child < 0) {
+        fprintf(stderr, "ERROR: Could not fork to run day %s: %s.\n", day, strerror(errno));
+        return false;
+    } else if (child == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        setenv("INTCODE_STATS_FILE", statsPath, 1);
+        execv(path, (char *const *)args);
+        fprintf(stderr, "ERROR: Could not run %s: %s.\n", path, strerror(errno));
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) < 0) {
+        fprintf(stderr, "ERROR: Could not wait for day %s: %s.\n", day, strerror(errno));
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "ERROR: Day %s failed with status %d.\n", day, status);
+        return false;
+    }
+
+    *seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    *rssKb = usage.ru_maxrss;
+    *instructions = 0;
+    FILE *stats = fopen(statsPath, "r");
+    if (stats != 0) {
+        if (fscanf(stats, "instructions %lld", instructions) != 1) {
+            *instructions = 0;
+        }
+        fclose(stats);
+    }
+    return true;
+}
+
+const char *const *arguments_for(const char *day) {
+    for (int i = 0; i < sizeof(DAY_ARGUMENTS) / sizeof(DAY_ARGUMENTS[0]); i++) {
+        if (strcmp(DAY_ARGUMENTS[i].day, day) == 0) {
+            return DAY_ARGUMENTS[i].args;
+        }
+    }
+    return 0;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted sample.
+double percentile(double *sorted, int count, double p) {
+    int rank = (int)(p * count + 0.999999);
+    rank = (rank < 1) ? 1 : (rank > count) ? count : rank;
+    return sorted[rank - 1];
+}
@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "debug.h"
+
+#if TRACE_LEVEL > TRACE_LEVEL_OFF
+
+#define TRACE_BUFFER_RECORDS 4096 // A power of two.
+#define TRACE_MESSAGE_LENGTH 112
+#define TRACE_OUTPUT_BUFFER 65536
+#define TRACE_IDLE_NANOS 1000000
+
+// A record is published by storing its claim index + 1 in sequence, after the rest is written.
+typedef struct {
+    unsigned long long sequence;
+    long long nanos;
+    int level;
+    int category;
+    char message[TRACE_MESSAGE_LENGTH];
+} TraceRecord;
+
+static TraceRecord records[TRACE_BUFFER_RECORDS];
+static unsigned long long head; // Next record to write out; only advanced by the writer thread.
+static unsigned long long tail; // Next record to claim.
+static unsigned long long dropped;
+static bool stopping;
+static bool disabled; // Set if the writer thread couldn't be started.
+static struct timespec started;
+static pthread_t writer;
+static pthread_once_t startOnce = PTHREAD_ONCE_INIT;
+
+static void start_writer();
+static void stop_writer();
+static void *writer_main(void *);
+static long long nanos_since_start();
+static const char *level_name(int level);
+static const char *category_name(int category);
+
+void trace_write(int level, int category, const char *format, ...) {
+    pthread_once(&startOnce, start_writer);
+    if (disabled) {
+        return;
+    }
+
+    // Claim a slot, unless that would overwrite one the writer hasn't reached yet.
+    unsigned long long claimed = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    do {
+        if (claimed - __atomic_load_n(&head, __ATOMIC_ACQUIRE) >= TRACE_BUFFER_RECORDS) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&tail, &claimed, claimed + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    TraceRecord *record = &records[claimed & (TRACE_BUFFER_RECORDS - 1)];
+    record->nanos = nanos_since_start();
+    record->level = level;
+    record->category = category;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record->message, TRACE_MESSAGE_LENGTH, format, args);
+    va_end(args);
+    __atomic_store_n(&record->sequence, claimed + 1, __ATOMIC_RELEASE);
+}
+
+void trace_flush() {
+    if (disabled) {
+        return;
+    }
+    unsigned long long target = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    struct timespec idle = { 0, TRACE_IDLE_NANOS };
+    while (__atomic_load_n(&head, __ATOMIC_ACQUIRE) < target) {
+        nanosleep(&idle, 0);
+    }
+}
+
+static void start_writer() {
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (pthread_create(&writer, 0, writer_main, 0) != 0) {
+        fprintf(stderr, "ERROR: Could not start the trace writer; tracing is disabled.\n");
+        disabled = true;
+        return;
+    }
+    atexit(stop_writer);
+}
+
+// Runs at exit: writes out whatever is left, then reports any records that were dropped.
+static void stop_writer() {
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    pthread_join(writer, 0);
+    unsigned long long lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    if (lost > 0) {
+        fprintf(stderr, "Trace: %llu records were dropped because the buffer was full.\n", lost);
+    }
+}
+
+static void *writer_main(void *context) {
+    static char output[TRACE_OUTPUT_BUFFER];
+    size_t length = 0;
+    struct timespec idle = { 0, TRACE_IDLE_NANOS };
+
+    while (1) {
+        unsigned long long next = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        TraceRecord *record = &records[next & (TRACE_BUFFER_RECORDS - 1)];
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) == next + 1) {
+            if (length + TRACE_MESSAGE_LENGTH + 64 > TRACE_OUTPUT_BUFFER) {
+                fwrite(output, 1, length, stderr);
+                length = 0;
+            }
+            length += snprintf(output + length, TRACE_OUTPUT_BUFFER - length, "[%12.6f] %-5s %-5s %s\n",
+                               record->nanos / 1e9, level_name(record->level),
+                               category_name(record->category), record->message);
+            __atomic_store_n(&head, next + 1, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        // Nothing ready: write out what we have, then stop or wait for more.
+        if (length > 0) {
+            fwrite(output, 1, length, stderr);
+            length = 0;
+        }
+        if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE) && next == __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        nanosleep(&idle, 0);
+    }
+}
+
+static long long nanos_since_start() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - started.tv_sec) * 1000000000LL + (now.tv_nsec - started.tv_nsec);
+}
+
+static const char *level_name(int level) {
+    switch (level) {
+        case TRACE_LEVEL_ERROR:
+            return "ERROR";
+        case TRACE_LEVEL_INFO:
+            return "INFO";
+        default:
+            return "TRACE";
+    }
+}
+
+static const char *category_name(int category) {
+    switch (category) {
+        case TRACE_VM:
+            return "VM";
+        case TRACE_IO:
+            return "IO";
+        case TRACE_JIT:
+            return "JIT";
+        case TRACE_SCHED:
+            return "SCHED";
+        case TRACE_DAY:
+            return "DAY";
+        default:
+            return "?";
+    }
+}
+
+#endif
@@ -1,14 +1,47 @@
 #ifndef DEBUG_H
 #define DEBUG_H 1
 
-#ifdef DEBUG_ENABLE
-    #if DEBUG_ENABLE > 0
-        #define debug(...) printf(__VA_ARGS__)
-    #else
-        #define debug(...)
-    #endif
+// Leveled tracing, chosen at build time (make TRACE=<level> TRACE_CATEGORIES="VM JIT ...").
+// Records go into an in-memory ring buffer without taking a lock, and a background thread writes
+// them to stderr, so tracing costs a formatted copy rather than a stdio call. Records are dropped
+// (and counted) if the writer falls a whole buffer behind. Calls above TRACE_LEVEL, or outside
+// TRACE_CATEGORIES, compile to nothing.
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_INFO 2
+#define TRACE_LEVEL_TRACE 3
+
+#define TRACE_VM 0x01 // Instruction execution.
+#define TRACE_IO 0x02 // Input, output and yields.
+#define TRACE_JIT 0x04 // Native compilation.
+#define TRACE_SCHED 0x08 // The M:N scheduler.
+#define TRACE_DAY 0x10 // The puzzle solutions themselves.
+#define TRACE_ALL 0xff
+
+#ifndef TRACE_LEVEL
+    #define TRACE_LEVEL TRACE_LEVEL_OFF
+#endif
+#ifndef TRACE_CATEGORIES
+    #define TRACE_CATEGORIES TRACE_ALL
+#endif
+
+#if TRACE_LEVEL > TRACE_LEVEL_OFF
+    void trace_write(int level, int category, const char *format, ...)
+        __attribute__((format(printf, 3, 4)));
+    void trace_flush(); // Blocks until everything traced so far has been written.
+    #define trace(level, category, ...) \
+        do { \
+            if ((level) <= TRACE_LEVEL && ((category) & (TRACE_CATEGORIES))) { \
+                trace_write((level), (category), __VA_ARGS__); \
+            } \
+        } while (0)
 #else
-    #define debug(...)
+    #define trace(level, category, ...) do {} while (0)
+    #define trace_flush() do {} while (0)
 #endif
 
+#define trace_error(category, ...) trace(TRACE_LEVEL_ERROR, category, __VA_ARGS__)
+#define trace_info(category, ...) trace(TRACE_LEVEL_INFO, category, __VA_ARGS__)
+#define trace_trace(category, ...) trace(TRACE_LEVEL_TRACE, category, __VA_ARGS__)
+
 #endif
@@ -0,0 +1,330 @@
+#include "intcode.h"
+
+// Translates an Intcode tape into a C translation unit with one label per reachable instruction.
+// Linking the output into a program registers it with the intcode library, so any tape parsed
+// with exactly the same contents runs as native code.
+// Usage: intcode-aot <tape> <output.c>
+
+typedef struct {
+    long long length;
+    const long long *values;
+    bool *reachable;
+    unsigned char *codeCells;
+} Translation;
+
+void find_reachable(Translation *);
+void emit_translation(FILE *out, Translation *, const char *source);
+void emit_instruction(FILE *out, Translation *, long long addr);
+void emit_operand(FILE *out, AddressMode mode, long long raw);
+bool operands_are_valid(DecodedInstruction instr, int params, bool hasDestination);
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <tape> <output.c>\n", argv[0]);
+        return 1;
+    }
+
+    Tape *tape = tape_load(argv[1]);
+    if (tape == 0) {
+        return 1;
+    }
+
+    long long *values = malloc(sizeof(long long) * (tape->count + 1));
+    for (long long i = 0; i < tape->count; i++) {
+        values[i] = tape_get(tape, i);
+    }
+
+    Translation translation;
+    translation.length = tape->count;
+    translation.values = values;
+    translation.reachable = calloc(tape->count, sizeof(bool));
+    translation.codeCells = calloc(tape->count, 1);
+    find_reachable(&translation);
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == 0) {
+        fprintf(stderr, "ERROR: Could not open %s for writing.\n", argv[2]);
+        return 1;
+    }
+    emit_translation(out, &translation, argv[1]);
+    fclose(out);
+
+    free(translation.reachable);
+    free(translation.codeCells);
+    free(values);
+    tape_free(tape);
+}
+
+// Walks the control flow from address 0. Jumps through memory can't be followed statically, but
+// compiled Intcode pushes its return addresses as immediates into the relative-base stack, so
+// those are treated as entry points too. Anything missed is still handled by the interpreter.
+void find_reachable(Translation *t) {
+    long long *worklist = malloc(sizeof(long long) * (t->length * 3 + 1));
+    int pending = 0;
+    worklist[pending++] = 0;
+
+    while (pending > 0) {
+        long long addr = worklist[--pending];
+        if (addr < 0 || addr >= t->length || t->reachable[addr]) {
+            continue;
+        }
+
+        DecodedInstruction instr = decode_instruction(t->values[addr]);
+        int params = parameter_count(instr.opcode);
+        if (params < 0 || addr + params >= t->length) {
+            continue;
+        }
+
+        t->reachable[addr] = true;
+        for (int i = 0; i <= params; i++) {
+            t->codeCells[addr + i] = 1;
+        }
+
+        if (instr.opcode == HALT) {
+            continue;
+        }
+        worklist[pending++] = addr + 1 + params;
+
+        if ((instr.opcode == JUMP_IF_TRUE || instr.opcode == JUMP_IF_FALSE) && instr.modes[1] == IMMEDIATE) {
+            worklist[pending++] = t->values[addr + 2];
+        }
+        if (params == 3 && instr.modes[2] == RELATIVE) {
+            for (int i = 0; i < 2; i++) {
+                if (instr.modes[i] == IMMEDIATE) {
+                    worklist[pending++] = t->values[addr + 1 + i];
+                }
+            }
+        }
+    }
+
+    free(worklist);
+}
+
+void emit_translation(FILE *out, Translation *t, const char *source) {
+    fprintf(out, "// Generated by intcode-aot from %s. Do not edit.\n", source);
+    fprintf(out, "#include \"intcode.h\"\n\n");
+    fprintf(out, "#define LENGTH %lldLL\n\n", t->length);
+
+    fprintf(out, "static const long long image[LENGTH] = {");
+    for (long long i = 0; i < t->length; i++) {
+        fprintf(out, "%s%lldLL", (i % 8 == 0) ? "\n    " : " ", t->values[i]);
+        if (i + 1 < t->length) {
+            fprintf(out, ",");
+        }
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const unsigned char codeCells[LENGTH] = {");
+    for (long long i = 0; i < t->length; i++) {
+        fprintf(out, "%s%d", (i % 32 == 0) ? "\n    " : "", t->codeCells[i]);
+        if (i + 1 < t->length) {
+            fprintf(out, ",");
+        }
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out,
+        "static inline long long aot_read(State *state, long long addr) {\n"
+        "    Tape *tape = state->tape;\n"
+        "    unsigned long long pageIdx = (unsigned long long)addr >> TAPE_PAGE_BITS;\n"
+        "    if (pageIdx < (unsigned long long)tape->pageCount && tape->pages[pageIdx] != 0) {\n"
+        "        return tape->pages[pageIdx]->values[addr & TAPE_PAGE_MASK];\n"
+        "    }\n"
+        "    return tape_get(tape, addr);\n"
+        "}\n\n"
+        "// Returns false if the write failed or landed on translated code, which detaches this program\n"
+        "// from the tape.\n"
+        "static inline bool aot_write(State *state, long long addr, long long value) {\n"
+        "    Tape *tape = state->tape;\n"
+        "    unsigned long long pageIdx = (unsigned long long)addr >> TAPE_PAGE_BITS;\n"
+        "    TapePage *page = (pageIdx < (unsigned long long)tape->pageCount) ? tape->pages[pageIdx] : 0;\n"
+        "    if (page != 0 && page->refs == 1\n"
+        "            && (addr >= LENGTH || codeCells[addr] == 0)\n"
+        "            && (addr >= tape->codeLimit || tape->codeMap[addr] == 0)) {\n"
+        "        page->values[addr & TAPE_PAGE_MASK] = value;\n"
+        "        page->decoded[addr & TAPE_PAGE_MASK].opcode = 0;\n"
+        "        if (addr >= tape->count) {\n"
+        "            tape->count = addr + 1;\n"
+        "        }\n"
+        "        return true;\n"
+        "    }\n\n"
+        "    update_or_error(state, addr, value);\n"
+        "    return is_running(state) && tape->native != 0;\n"
+        "}\n\n");
+
+    fprintf(out,
+        "static bool run_native(State *state, bool stopOnOutput) {\n"
+        "    long long ptr = state->ptr;\n"
+        "    long long rb = state->relativeBase;\n"
+        "    long long ticks = state->ticks;\n"
+        "    long long limit = state->tickLimit;\n"
+        "    bool handled = true;\n"
+        "    long long a, b;\n"
+        "    goto dispatch;\n\n"
+        "dispatch:\n"
+        "    switch (ptr) {\n");
+    for (long long i = 0; i < t->length; i++) {
+        if (t->reachable[i]) {
+            fprintf(out, "        case %lld: goto L%lld;\n", i, i);
+        }
+    }
+    fprintf(out,
+        "        default: goto fallback;\n"
+        "    }\n\n");
+
+    for (long long i = 0; i < t->length; i++) {
+        if (t->reachable[i]) {
+            emit_instruction(out, t, i);
+        }
+    }
+
+    fprintf(out,
+        "fallback:\n"
+        "    handled = false;\n"
+        "stop:\n"
+        "    state->ptr = ptr;\n"
+        "    state->relativeBase = rb;\n"
+        "    state->ticks = ticks;\n"
+        "    return handled;\n"
+        "}\n\n"
+        "static const NativeProgram program = { image, LENGTH, codeCells, run_native };\n\n"
+        "__attribute__((constructor)) static void register_program() {\n"
+        "    native_register(&program);\n"
+        "}\n");
+}
+
+bool operands_are_valid(DecodedInstruction instr, int params, bool hasDestination) {
+    for (int i = 0; i < params; i++) {
+        if (instr.modes[i] != POSITION && instr.modes[i] != IMMEDIATE && instr.modes[i] != RELATIVE) {
+            return false;
+        }
+    }
+    return !hasDestination || instr.modes[params - 1] != IMMEDIATE;
+}
+
+void emit_operand(FILE *out, AddressMode mode, long long raw) {
+    switch (mode) {
+        case POSITION:
+            fprintf(out, "aot_read(state, %lldLL)", raw);
+            break;
+        case IMMEDIATE:
+            fprintf(out, "%lldLL", raw);
+            break;
+        case RELATIVE:
+            fprintf(out, "aot_read(state, rb + %lldLL)", raw);
+            break;
+    }
+}
+
+static void emit_destination(FILE *out, AddressMode mode, long long raw) {
+    if (mode == RELATIVE) {
+        fprintf(out, "rb + %lldLL", raw);
+    } else {
+        fprintf(out, "%lldLL", raw);
+    }
+}
+
+void emit_instruction(FILE *out, Translation *t, long long addr) {
+    DecodedInstruction instr = decode_instruction(t->values[addr]);
+    int params = parameter_count(instr.opcode);
+    const long long *operands = &t->values[addr + 1];
+    long long next = addr + 1 + params;
+    bool hasDestination = (params == 3 || instr.opcode == INPUT);
+
+    fprintf(out, "L%lld:\n", addr);
+    if (!operands_are_valid(instr, params, hasDestination)) {
+        // Let the interpreter report the bad instruction.
+        fprintf(out, "    ptr = %lldLL;\n    goto fallback;\n", addr);
+        return;
+    }
+
+    fprintf(out, "    if (ticks >= limit) {\n        ptr = %lldLL;\n        goto stop;\n    }\n", addr);
+    fprintf(out, "    ticks++;\n");
+    switch (instr.opcode) {
+        case ADD:
+        case MULTIPLY:
+        case LESS_THAN:
+        case EQUALS:
+            fprintf(out, "    a = ");
+            emit_operand(out, instr.modes[0], operands[0]);
+            fprintf(out, ";\n    b = ");
+            emit_operand(out, instr.modes[1], operands[1]);
+            fprintf(out, ";\n    if (!aot_write(state, ");
+            emit_destination(out, instr.modes[2], operands[2]);
+            switch (instr.opcode) {
+                case ADD:
+                    fprintf(out, ", a + b)) {\n");
+                    break;
+                case MULTIPLY:
+                    fprintf(out, ", a * b)) {\n");
+                    break;
+                case LESS_THAN:
+                    fprintf(out, ", a < b)) {\n");
+                    break;
+                default:
+                    fprintf(out, ", a == b)) {\n");
+            }
+            fprintf(out, "        ptr = %lldLL;\n        goto fallback;\n    }\n", next);
+            break;
+        case INPUT:
+            fprintf(out,
+                "    if (!state->io.read(state->io.context, &a)) {\n"
+                "        if (state->io.yieldWhenEmpty) {\n"
+                "            ticks--;\n"
+                "            state->status = NEEDS_INPUT;\n"
+                "            ptr = %lldLL;\n"
+                "            goto stop;\n"
+                "        }\n"
+                "        fprintf(stderr, \"ERROR: Input requested at address %%lld, but none is available.\\n\", %lldLL);\n"
+                "        state->status = ERROR;\n"
+                "        ptr = %lldLL;\n"
+                "        goto stop;\n"
+                "    }\n"
+                "    if (!aot_write(state, ", addr, next, next);
+            emit_destination(out, instr.modes[0], operands[0]);
+            fprintf(out, ", a)) {\n        ptr = %lldLL;\n        goto fallback;\n    }\n", next);
+            break;
+        case OUTPUT:
+            fprintf(out, "    state->outputs++;\n    state->io.write(state->io.context, ");
+            emit_operand(out, instr.modes[0], operands[0]);
+            fprintf(out, ");\n    if (stopOnOutput) {\n        ptr = %lldLL;\n        goto stop;\n    }\n", next);
+            break;
+        case JUMP_IF_TRUE:
+        case JUMP_IF_FALSE:
+            fprintf(out, "    if (");
+            emit_operand(out, instr.modes[0], operands[0]);
+            fprintf(out, instr.opcode == JUMP_IF_TRUE ? " != 0) {\n" : " == 0) {\n");
+            if (instr.modes[1] == IMMEDIATE && operands[1] >= 0 && operands[1] < t->length
+                    && t->reachable[operands[1]]) {
+                fprintf(out, "        goto L%lld;\n", operands[1]);
+            } else {
+                fprintf(out, "        ptr = ");
+                emit_operand(out, instr.modes[1], operands[1]);
+                fprintf(out, ";\n        goto dispatch;\n");
+            }
+            fprintf(out, "    }\n");
+            break;
+        case ADJUST_RELATIVE_BASE:
+            fprintf(out, "    rb += ");
+            emit_operand(out, instr.modes[0], operands[0]);
+            fprintf(out, ";\n");
+            break;
+        case HALT:
+            fprintf(out, "    state->status = COMPLETE;\n    ptr = %lldLL;\n    goto stop;\n", next);
+            return;
+        default:
+            break;
+    }
+
+    // Fall through only if the next label emitted is the next instruction; overlapping
+    // decodes can put another label in between.
+    long long following = addr + 1;
+    while (following < t->length && !t->reachable[following]) {
+        following++;
+    }
+    if (next >= t->length || !t->reachable[next]) {
+        fprintf(out, "    ptr = %lldLL;\n    goto fallback;\n", next);
+    } else if (following != next) {
+        fprintf(out, "    goto L%lld;\n", next);
+    }
+}
@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "intcode.h"
+
+// Runs an Intcode tape repeatedly and reports interpreter throughput.
+// Usage: intcode-bench <tape> <iterations> [input values...]
+
+typedef struct {
+    long long *inputs;
+    int inputCount;
+    int nextInput;
+    long long lastOutput;
+    long long outputCount;
+} BenchIo;
+
+bool bench_read(void *context, long long *value);
+void bench_write(void *context, long long value);
+double elapsed_seconds(struct timespec *start, struct timespec *end);
+const char *dispatch_name();
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <tape> <iterations> [input values...]\n", argv[0]);
+        return 1;
+    }
+
+    char *path = argv[1];
+    int iterations = atoi(argv[2]);
+    BenchIo io;
+    io.inputCount = argc - 3;
+    io.inputs = malloc(sizeof(long long) * (io.inputCount + 1));
+    for (int i = 0; i < io.inputCount; i++) {
+        io.inputs[i] = atoll(argv[i + 3]);
+    }
+
+    long long totalTicks = 0;
+    double totalSeconds = 0;
+    for (int i = 0; i < iterations; i++) {
+        Tape *tape = tape_load(path);
+        if (tape == 0) {
+            return 1;
+        }
+
+        State *state = state_init(tape);
+        state->io.read = bench_read;
+        state->io.write = bench_write;
+        state->io.context = &io;
+        io.nextInput = 0;
+        io.outputCount = 0;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run(state);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        totalTicks += state->ticks;
+        totalSeconds += elapsed_seconds(&start, &end);
+        state_free(state);
+        tape_free(tape);
+    }
+
+    printf("%s dispatch: %d runs of %s, %lld instructions in %.3fs (%.1f M instructions/s). Last output %lld.\n",
+           dispatch_name(), iterations, path, totalTicks, totalSeconds,
+           totalTicks / totalSeconds / 1e6, io.lastOutput);
+    free(io.inputs);
+}
+
+bool bench_read(void *context, long long *value) {
+    BenchIo *io = context;
+    if (io->nextInput >= io->inputCount) {
+        return false;
+    }
+
+    *value = io->inputs[io->nextInput++];
+    return true;
+}
+
+void bench_write(void *context, long long value) {
+    BenchIo *io = context;
+    io->lastOutput = value;
+    io->outputCount++;
+}
+
+double elapsed_seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+const char *dispatch_name() {
+#if defined(INTCODE_JIT) && defined(__x86_64__)
+    return "Threaded+JIT";
+#elif defined(INTCODE_THREADED_DISPATCH)
+    return "Threaded";
+#else
+    return "Switch";
+#endif
+}
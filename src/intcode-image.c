@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "intcode.h"
+
+// A tape image is a header followed by the tape's pages exactly as they sit in memory: values,
+// pre-decoded instructions and all. Mapping the file privately turns it straight into a Tape whose
+// pages are the mapping, so loading costs one checksum pass rather than parsing. Image pages carry
+// a huge reference count, which makes them read-only to the tape code: the first write to one
+// copies it to the heap as for any shared page, and releasing one never frees it.
+
+#define TAPE_IMAGE_MAGIC "ICTAPE\r\n"
+#define TAPE_IMAGE_VERSION 2
+#define TAPE_IMAGE_ALIGNMENT 4096
+#define TAPE_IMAGE_REFS (INT_MAX / 2)
+#define TAPE_IMAGE_BYTE_ORDER 0x0102030405060708ULL
+#define HASH_BASIS 14695981039346656037ULL
+#define HASH_PRIME 1099511628211ULL
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int pageBits; // The layout must match this build's TapePage exactly...
+    unsigned long long pageBytes;
+    unsigned long long byteOrder; // ...including its byte order.
+    long long count;
+    long long pageCount;
+    unsigned long long checksum; // Over every page's values and decoded slots.
+    unsigned long long pagesOffset;
+    long long sourceSize; // Of the text the image was made from, or -1 if it wasn't recorded.
+    long long sourceModified; // The text's mtime, in nanoseconds.
+    unsigned long long sourceHash; // Of the text's contents.
+} TapeImageHeader;
+
+static unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t length);
+static unsigned long long hash_page(unsigned long long hash, TapePage *page);
+static bool describe_source(const char *path, TapeImageHeader *header);
+static Tape *map_image(const char *path, const char *text, long long length, long long modified);
+
+// The image is written beside path and renamed over it, so processes that have the old image mapped
+// keep their pages rather than seeing the file truncated underneath them.
+bool tape_write_image(Tape *tape, const char *path, const char *sourcePath) {
+    TapeImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TAPE_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = TAPE_IMAGE_VERSION;
+    header.pageBits = TAPE_PAGE_BITS;
+    header.pageBytes = sizeof(TapePage);
+    header.byteOrder = TAPE_IMAGE_BYTE_ORDER;
+    header.count = tape->count;
+    header.pageCount = (tape->count + TAPE_PAGE_MASK) >> TAPE_PAGE_BITS;
+    header.checksum = HASH_BASIS;
+    header.pagesOffset = TAPE_IMAGE_ALIGNMENT;
+    header.sourceSize = -1;
+    if (sourcePath != 0 && !describe_source(sourcePath, &header)) {
+        return false;
+    }
+
+    size_t pathLength = strlen(path);
+    char *partial = malloc(pathLength + sizeof(".partial"));
+    memcpy(partial, path, pathLength);
+    strcpy(partial + pathLength, ".partial");
+    FILE *out = fopen(partial, "wb");
+    if (out == 0) {
+        fprintf(stderr, "ERROR: Could not open %s for writing.\n", partial);
+        free(partial);
+        return false;
+    }
+
+    // The header goes in last, once the checksum is known.
+    bool written = fseek(out, header.pagesOffset, SEEK_SET) == 0;
+    TapePage *image = malloc(sizeof(TapePage));
+    for (long long p = 0; p < header.pageCount && written; p++) {
+        memset(image, 0, sizeof(TapePage));
+        image->refs = TAPE_IMAGE_REFS;
+        TapePage *page = tape_page(tape, p << TAPE_PAGE_BITS);
+        long long cells = tape->count - (p << TAPE_PAGE_BITS);
+        cells = (cells < TAPE_PAGE_SIZE) ? cells : TAPE_PAGE_SIZE;
+        for (long long i = 0; i < cells; i++) {
+            long long value = (page != 0) ? page->values[i] : 0;
+            image->values[i] = value;
+            image->decoded[i] = decode_instruction(value);
+        }
+        header.checksum = hash_page(header.checksum, image);
+        written = fwrite(image, sizeof(TapePage), 1, out) == 1;
+    }
+    free(image);
+    written = written && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+
+    written = (fclose(out) == 0) && written && rename(partial, path) == 0;
+    if (!written) {
+        fprintf(stderr, "ERROR: Could not write the tape image %s.\n", path);
+        unlink(partial);
+    }
+    free(partial);
+    return written;
+}
+
+Tape *tape_map(const char *path) {
+    return map_image(path, 0, 0, 0);
+}
+
+// Quietly gives up if there's no image, or it was made from other text; the caller parses instead.
+Tape *tape_map_for_text(const char *textPath, const char *text, long long length) {
+    size_t stem = strlen(textPath);
+    if (stem < strlen(".txt") || strcmp(textPath + stem - strlen(".txt"), ".txt") != 0) {
+        return 0;
+    }
+    stem -= strlen(".txt");
+    char *imagePath = malloc(stem + sizeof(".tape"));
+    memcpy(imagePath, textPath, stem);
+    strcpy(imagePath + stem, ".tape");
+
+    struct stat source;
+    Tape *tape = 0;
+    if (stat(textPath, &source) == 0 && access(imagePath, F_OK) == 0) {
+        long long modified = source.st_mtim.tv_sec * 1000000000LL + source.st_mtim.tv_nsec;
+        tape = map_image(imagePath, text, length, modified);
+    }
+    free(imagePath);
+    return tape;
+}
+
+// With text given, the image is only used if it records that text as its source. The mapping is
+// never unmapped once it becomes a tape, since clones may share its pages for as long as the
+// process runs.
+static Tape *map_image(const char *path, const char *text, long long length, long long modified) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Could not open tape image %s.\n", path);
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(TapeImageHeader)) {
+        fprintf(stderr, "ERROR: %s is too short to be a tape image.\n", path);
+        close(fd);
+        return 0;
+    }
+
+    // Writable, since reference counts are updated in place, but private, so the file never changes.
+    char *data = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Could not map tape image %s.\n", path);
+        return 0;
+    }
+
+    TapeImageHeader *header = (TapeImageHeader *)data;
+    unsigned long long size = (unsigned long long)info.st_size;
+    const char *problem = 0;
+    if (memcmp(header->magic, TAPE_IMAGE_MAGIC, sizeof(header->magic)) != 0) {
+        problem = "it isn't a tape image";
+    } else if (header->version != TAPE_IMAGE_VERSION || header->pageBits != TAPE_PAGE_BITS
+               || header->pageBytes != sizeof(TapePage) || header->byteOrder != TAPE_IMAGE_BYTE_ORDER) {
+        problem = "it was written by an incompatible build";
+    } else if (header->pagesOffset < sizeof(TapeImageHeader) || header->pagesOffset > size
+               || header->pagesOffset % sizeof(long long) != 0 || header->pageCount < 0
+               || (unsigned long long)header->pageCount > (size - header->pagesOffset) / sizeof(TapePage)
+               || header->count < 0 || header->count > header->pageCount * TAPE_PAGE_SIZE) {
+        problem = "it is truncated or corrupt";
+    }
+    if (problem != 0) {
+        fprintf(stderr, "ERROR: Could not load tape image %s: %s.\n", path, problem);
+        munmap(data, info.st_size);
+        return 0;
+    }
+    if (text != 0 && (header->sourceSize != length || header->sourceModified != modified
+                      || header->sourceHash != hash_bytes(HASH_BASIS, text, length))) {
+        munmap(data, info.st_size);
+        return 0;
+    }
+
+    TapePage *pages = (TapePage *)(data + header->pagesOffset);
+    unsigned long long checksum = HASH_BASIS;
+    for (long long p = 0; p < header->pageCount; p++) {
+        checksum = hash_page(checksum, &pages[p]);
+    }
+    if (checksum != header->checksum) {
+        fprintf(stderr, "ERROR: Could not load tape image %s: its checksum doesn't match.\n", path);
+        munmap(data, info.st_size);
+        return 0;
+    }
+
+    Tape *tape = tape_init();
+    for (long long p = 0; p < header->pageCount; p++) {
+        TapePage **slot = tape_page_slot(tape, p);
+        if (slot == 0) {
+            tape_free(tape);
+            munmap(data, info.st_size);
+            return 0;
+        }
+        *slot = &pages[p];
+    }
+    tape->count = header->count;
+    tape_match_native(tape);
+    return tape;
+}
+
+static bool describe_source(const char *path, TapeImageHeader *header) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "ERROR: Could not read the tape image's source %s.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    header->sourceSize = info.st_size;
+    header->sourceModified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    header->sourceHash = HASH_BASIS;
+    if (info.st_size > 0) {
+        void *text = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            fprintf(stderr, "ERROR: Could not map the tape image's source %s.\n", path);
+            close(fd);
+            return false;
+        }
+        header->sourceHash = hash_bytes(HASH_BASIS, text, info.st_size);
+        munmap(text, info.st_size);
+    }
+    close(fd);
+    return true;
+}
+
+// The values and decoded slots, which is everything a tape reads from an image page.
+static unsigned long long hash_page(unsigned long long hash, TapePage *page) {
+    hash = hash_bytes(hash, page->values, sizeof(page->values));
+    return hash_bytes(hash, page->decoded, sizeof(page->decoded));
+}
+
+// FNV-1a taken eight bytes at a time, which keeps a checksum pass well ahead of parsing.
+static unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        unsigned long long word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * HASH_PRIME;
+    }
+    if (i < length) {
+        unsigned long long word = 0;
+        memcpy(&word, bytes + i, length - i);
+        hash = (hash ^ word) * HASH_PRIME;
+    }
+    return hash;
+}
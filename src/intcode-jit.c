@@ -0,0 +1,732 @@
+#define _DEFAULT_SOURCE
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "intcode.h"
+#include "debug.h"
+
+#if defined(INTCODE_JIT) && defined(__x86_64__)
+
+// A block is a run of ADD/MULTIPLY/LESS_THAN/EQUALS/ADJUST_RELATIVE_BASE instructions, optionally
+// ending in a conditional jump. Operands, modes and constant addresses are baked into the code.
+// Anything the native code can't handle cheaply (negative addresses, writes to compiled addresses,
+// writes to pages that are missing or shared, pages past the dense directory) leaves through a side
+// exit that stores the machine state as it was before the offending instruction, so the
+// interpreter can carry on from there.
+// Only code below the tape's codeLimit, fixed when the JIT first starts, is ever compiled.
+// Until some address gets hot, a tape only has a small table of hashed jump counts; most clones never
+// get that far, so they never pay for the arena or the per-address tables.
+#define JIT_HOT_THRESHOLD 50
+#define JIT_WARM_SLOTS 256
+#define JIT_MAX_STRIKES 4
+#define JIT_MAX_BLOCK_INSTRUCTIONS 64
+#define JIT_MAX_EXITS (JIT_MAX_BLOCK_INSTRUCTIONS * 10)
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_INSTRUCTIONS * 600)
+#define JIT_ARENA_SIZE (1 << 20)
+#define JIT_MAX_ADDRESS (1LL << 28) // Keeps constant addresses and page offsets inside 32-bit displacements.
+
+typedef void (*NativeBlock)(State *);
+
+typedef struct {
+    long long start;
+    long long end; // Exclusive.
+} JitBlock;
+
+struct JitCache {
+    unsigned short warm[JIT_WARM_SLOTS]; // Jump counts by address modulo the size, until the arena is mapped.
+    bool disabled; // Set if the arena or tables couldn't be allocated.
+    unsigned char *arena; // Null until jit_init; the fields below are only valid once it's set.
+    size_t arenaUsed;
+    JitBlock *blocks;
+    int blockCount;
+    int blockCapacity;
+    NativeBlock *entries; // The per-address arrays are all tape->codeLimit long.
+    unsigned short *hotness;
+    unsigned char *strikes; // Times a block starting here was invalidated; too many and we give up on it.
+    unsigned char *lengths; // Instructions in the block starting here, so budgets are never overrun.
+};
+
+typedef enum { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11 } Register;
+
+// Register assignment inside a block.
+#define REG_STATE RDI
+#define REG_PAGES RSI
+#define REG_PAGE_COUNT RDX
+#define REG_RELATIVE_BASE R8
+#define REG_CODE_MAP R9
+#define REG_ADDRESS R10
+#define REG_PAGE R11
+
+#define PAGE_VALUES ((int)offsetof(TapePage, values))
+#define PAGE_DECODED ((int)offsetof(TapePage, decoded))
+
+typedef enum {
+    CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_S = 0x8, CC_L = 0xC, CC_G = 0xF, CC_ALWAYS = -1
+} Condition;
+
+typedef struct {
+    size_t patch; // Offset of the rel32 to point at this exit's stub.
+    long long ptr;
+    bool dynamicPtr; // If set, the new pointer is in RCX rather than ptr.
+    int ticks;
+} JitExit;
+
+typedef struct {
+    unsigned char code[JIT_MAX_BLOCK_BYTES];
+    size_t size;
+    JitExit exits[JIT_MAX_EXITS];
+    int exitCount;
+} Emitter;
+
+typedef struct {
+    AddressMode mode;
+    long long raw;
+} Operand;
+
+static bool jit_init(Tape *, JitCache *);
+bool jit_compile(Tape *, long long start);
+
+static void emit_byte(Emitter *e, unsigned char byte) {
+    e->code[e->size++] = byte;
+}
+
+static void emit_u32(Emitter *e, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        emit_byte(e, (value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void emit_u64(Emitter *e, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+        emit_byte(e, (value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void patch_u32(Emitter *e, size_t at, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        e->code[at + i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static void emit_rex(Emitter *e, int wide, int reg, int index, int base) {
+    unsigned char rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+    if (rex != 0x40) {
+        emit_byte(e, rex);
+    }
+}
+
+static void emit_modrm(Emitter *e, int mod, int reg, int rm) {
+    emit_byte(e, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emit_sib(Emitter *e, int scale, int index, int base) {
+    emit_byte(e, (scale << 6) | ((index & 7) << 3) | (base & 7));
+}
+
+// mov dst, [base + disp32]
+static void emit_load_disp(Emitter *e, Register dst, Register base, int disp) {
+    emit_rex(e, 1, dst, 0, base);
+    emit_byte(e, 0x8B);
+    emit_modrm(e, 2, dst, base);
+    emit_u32(e, disp);
+}
+
+// mov [base + disp32], src
+static void emit_store_disp(Emitter *e, Register base, int disp, Register src) {
+    emit_rex(e, 1, src, 0, base);
+    emit_byte(e, 0x89);
+    emit_modrm(e, 2, src, base);
+    emit_u32(e, disp);
+}
+
+// mov dst, [base + index*8 + disp32]
+static void emit_load_indexed(Emitter *e, Register dst, Register base, Register index, int disp) {
+    emit_rex(e, 1, dst, index, base);
+    emit_byte(e, 0x8B);
+    emit_modrm(e, 2, dst, 4);
+    emit_sib(e, 3, index, base);
+    emit_u32(e, disp);
+}
+
+// mov [base + index*8 + disp32], src
+static void emit_store_indexed(Emitter *e, Register base, Register index, int disp, Register src) {
+    emit_rex(e, 1, src, index, base);
+    emit_byte(e, 0x89);
+    emit_modrm(e, 2, src, 4);
+    emit_sib(e, 3, index, base);
+    emit_u32(e, disp);
+}
+
+static void emit_mov_imm(Emitter *e, Register dst, long long value) {
+    if (value >= -0x80000000LL && value <= 0x7FFFFFFFLL) {
+        emit_rex(e, 1, 0, 0, dst);
+        emit_byte(e, 0xC7);
+        emit_modrm(e, 3, 0, dst);
+        emit_u32(e, (unsigned int)value);
+    } else {
+        emit_rex(e, 1, 0, 0, dst);
+        emit_byte(e, 0xB8 + (dst & 7));
+        emit_u64(e, (unsigned long long)value);
+    }
+}
+
+// op dst, src for the two-operand ALU forms (add = 0x01, cmp = 0x39, test = 0x85, mov = 0x89).
+static void emit_alu(Emitter *e, unsigned char opcode, Register dst, Register src) {
+    emit_rex(e, 1, src, 0, dst);
+    emit_byte(e, opcode);
+    emit_modrm(e, 3, src, dst);
+}
+
+static void emit_imul(Emitter *e, Register dst, Register src) {
+    emit_rex(e, 1, dst, 0, src);
+    emit_byte(e, 0x0F);
+    emit_byte(e, 0xAF);
+    emit_modrm(e, 3, dst, src);
+}
+
+// The 0x81 group with an imm32: add = 0, and = 4, cmp = 7.
+static void emit_alu_imm(Emitter *e, int operation, Register dst, int value) {
+    emit_rex(e, 1, 0, 0, dst);
+    emit_byte(e, 0x81);
+    emit_modrm(e, 3, operation, dst);
+    emit_u32(e, value);
+}
+
+static void emit_add_imm(Emitter *e, Register dst, int value) {
+    emit_alu_imm(e, 0, dst, value);
+}
+
+// shr dst, imm8
+static void emit_shr_imm(Emitter *e, Register dst, int bits) {
+    emit_rex(e, 1, 0, 0, dst);
+    emit_byte(e, 0xC1);
+    emit_modrm(e, 3, 5, dst);
+    emit_byte(e, bits);
+}
+
+// cmp dword [base + disp32], imm8
+static void emit_cmp_dword_disp(Emitter *e, Register base, int disp, int value) {
+    emit_rex(e, 0, 0, 0, base);
+    emit_byte(e, 0x83);
+    emit_modrm(e, 2, 7, base);
+    emit_u32(e, disp);
+    emit_byte(e, value);
+}
+
+// cmp dst, [base + disp32]
+static void emit_cmp_disp(Emitter *e, Register dst, Register base, int disp) {
+    emit_rex(e, 1, dst, 0, base);
+    emit_byte(e, 0x3B);
+    emit_modrm(e, 2, dst, base);
+    emit_u32(e, disp);
+}
+
+// add qword [base + disp32], imm32
+static void emit_add_mem_imm(Emitter *e, Register base, int disp, int value) {
+    emit_rex(e, 1, 0, 0, base);
+    emit_byte(e, 0x81);
+    emit_modrm(e, 2, 0, base);
+    emit_u32(e, disp);
+    emit_u32(e, value);
+}
+
+// setcc al; movzx eax, al
+static void emit_set_rax(Emitter *e, Condition cc) {
+    emit_byte(e, 0x0F);
+    emit_byte(e, 0x90 | cc);
+    emit_modrm(e, 3, 0, RAX);
+    emit_byte(e, 0x0F);
+    emit_byte(e, 0xB6);
+    emit_modrm(e, 3, RAX, RAX);
+}
+
+// cmp byte [base + index], 0
+static void emit_cmp_byte_indexed(Emitter *e, Register base, Register index) {
+    emit_rex(e, 0, 0, index, base);
+    emit_byte(e, 0x80);
+    emit_modrm(e, 0, 7, 4);
+    emit_sib(e, 0, index, base);
+    emit_byte(e, 0);
+}
+
+// cmp byte [base + disp32], 0
+static void emit_cmp_byte_disp(Emitter *e, Register base, int disp) {
+    emit_rex(e, 0, 0, 0, base);
+    emit_byte(e, 0x80);
+    emit_modrm(e, 2, 7, base);
+    emit_u32(e, disp);
+    emit_byte(e, 0);
+}
+
+// mov byte [base + index*4 + disp32], 0
+static void emit_clear_decoded_indexed(Emitter *e, Register base, Register index, int disp) {
+    emit_rex(e, 0, 0, index, base);
+    emit_byte(e, 0xC6);
+    emit_modrm(e, 2, 0, 4);
+    emit_sib(e, 2, index, base);
+    emit_u32(e, disp);
+    emit_byte(e, 0);
+}
+
+// mov byte [base + disp32], 0
+static void emit_clear_decoded_disp(Emitter *e, Register base, int disp) {
+    emit_rex(e, 0, 0, 0, base);
+    emit_byte(e, 0xC6);
+    emit_modrm(e, 2, 0, base);
+    emit_u32(e, disp);
+    emit_byte(e, 0);
+}
+
+// Emits a jump to a label later in the block, returning where to patch it once the label is known.
+static size_t emit_forward_jump(Emitter *e, Condition cc) {
+    if (cc == CC_ALWAYS) {
+        emit_byte(e, 0xE9);
+    } else {
+        emit_byte(e, 0x0F);
+        emit_byte(e, 0x80 | cc);
+    }
+    emit_u32(e, 0);
+    return e->size - 4;
+}
+
+static void patch_forward_jump(Emitter *e, size_t patch) {
+    patch_u32(e, patch, (unsigned int)(e->size - (patch + 4)));
+}
+
+static void emit_exit_jump(Emitter *e, Condition cc, long long ptr, bool dynamicPtr, int ticks) {
+    emit_byte(e, 0x0F);
+    emit_byte(e, 0x80 | cc);
+    JitExit *exit = &e->exits[e->exitCount++];
+    exit->patch = e->size;
+    exit->ptr = ptr;
+    exit->dynamicPtr = dynamicPtr;
+    exit->ticks = ticks;
+    emit_u32(e, 0);
+}
+
+// Writes back the registers that shadow the State and returns to the interpreter.
+static void emit_exit_inline(Emitter *e, long long ptr, bool dynamicPtr, int ticks) {
+    emit_store_disp(e, REG_STATE, offsetof(State, relativeBase), REG_RELATIVE_BASE);
+    if (ticks > 0) {
+        emit_add_mem_imm(e, REG_STATE, offsetof(State, ticks), ticks);
+    }
+    if (dynamicPtr) {
+        emit_store_disp(e, REG_STATE, offsetof(State, ptr), RCX);
+    } else {
+        emit_mov_imm(e, RAX, ptr);
+        emit_store_disp(e, REG_STATE, offsetof(State, ptr), RAX);
+    }
+    emit_byte(e, 0xC3);
+}
+
+static void emit_prologue(Emitter *e) {
+    emit_load_disp(e, RAX, REG_STATE, offsetof(State, tape));
+    emit_load_disp(e, REG_PAGES, RAX, offsetof(Tape, pages));
+    emit_load_disp(e, REG_PAGE_COUNT, RAX, offsetof(Tape, pageCount));
+    emit_load_disp(e, REG_CODE_MAP, RAX, offsetof(Tape, codeMap));
+    emit_load_disp(e, REG_RELATIVE_BASE, REG_STATE, offsetof(State, relativeBase));
+}
+
+static bool operand_is_compilable(Operand operand, bool isDestination) {
+    switch (operand.mode) {
+        case POSITION:
+            return operand.raw >= 0 && operand.raw < JIT_MAX_ADDRESS;
+        case IMMEDIATE:
+            return !isDestination;
+        case RELATIVE:
+            return operand.raw >= -0x80000000LL && operand.raw <= 0x7FFFFFFFLL;
+        default:
+            return false;
+    }
+}
+
+// Leaves REG_ADDRESS holding relativeBase + offset, exiting if it is negative.
+static void emit_relative_address(Emitter *e, long long offset, long long exitPtr, int ticks) {
+    emit_alu(e, 0x89, REG_ADDRESS, REG_RELATIVE_BASE);
+    emit_add_imm(e, REG_ADDRESS, (int)offset);
+    emit_alu(e, 0x85, REG_ADDRESS, REG_ADDRESS);
+    emit_exit_jump(e, CC_S, exitPtr, false, ticks);
+}
+
+// Leaves REG_PAGE holding the page for REG_ADDRESS and REG_ADDRESS its offset within the page.
+// Returns the patches for the two jumps taken if there is no such page.
+static void emit_page_lookup_indexed(Emitter *e, size_t missing[2]) {
+    emit_alu(e, 0x89, REG_PAGE, REG_ADDRESS);
+    emit_shr_imm(e, REG_PAGE, TAPE_PAGE_BITS);
+    emit_alu(e, 0x39, REG_PAGE, REG_PAGE_COUNT);
+    missing[0] = emit_forward_jump(e, CC_AE);
+    emit_load_indexed(e, REG_PAGE, REG_PAGES, REG_PAGE, 0);
+    emit_alu(e, 0x85, REG_PAGE, REG_PAGE);
+    missing[1] = emit_forward_jump(e, CC_E);
+    emit_alu_imm(e, 4, REG_ADDRESS, (int)TAPE_PAGE_MASK);
+}
+
+// As above, for an address known when compiling.
+static void emit_page_lookup_disp(Emitter *e, long long addr, size_t missing[2]) {
+    emit_alu_imm(e, 7, REG_PAGE_COUNT, (int)(addr >> TAPE_PAGE_BITS));
+    missing[0] = emit_forward_jump(e, CC_BE);
+    emit_load_disp(e, REG_PAGE, REG_PAGES, (int)((addr >> TAPE_PAGE_BITS) * sizeof(TapePage *)));
+    emit_alu(e, 0x85, REG_PAGE, REG_PAGE);
+    missing[1] = emit_forward_jump(e, CC_E);
+}
+
+// Memory that was never written reads as zero. Pages past the dense directory are left to the
+// interpreter, which knows how to look them up.
+static void emit_load_operand(Emitter *e, Register dst, Operand operand, long long exitPtr, int ticks) {
+    size_t missing[2];
+    if (operand.mode == IMMEDIATE) {
+        emit_mov_imm(e, dst, operand.raw);
+        return;
+    }
+
+    if (operand.mode == POSITION) {
+        emit_page_lookup_disp(e, operand.raw, missing);
+        emit_load_disp(e, dst, REG_PAGE, PAGE_VALUES + (int)((operand.raw & TAPE_PAGE_MASK) * 8));
+    } else {
+        emit_relative_address(e, operand.raw, exitPtr, ticks);
+        emit_page_lookup_indexed(e, missing);
+        emit_load_indexed(e, dst, REG_PAGE, REG_ADDRESS, PAGE_VALUES);
+    }
+    size_t done = emit_forward_jump(e, CC_ALWAYS);
+    JitExit *exit = &e->exits[e->exitCount++];
+    exit->patch = missing[0];
+    exit->ptr = exitPtr;
+    exit->dynamicPtr = false;
+    exit->ticks = ticks;
+    patch_forward_jump(e, missing[1]);
+    emit_mov_imm(e, dst, 0);
+    patch_forward_jump(e, done);
+}
+
+// Stores RAX to the destination operand. Writes that would land on compiled code, or that need a
+// page allocated or copied first, exit instead and leave the interpreter to perform them.
+static void emit_store_result(Emitter *e, Tape *tape, Operand operand, long long exitPtr, int ticks) {
+    size_t missing[2];
+    if (operand.mode == POSITION) {
+        if (operand.raw < tape->codeLimit) {
+            emit_cmp_byte_disp(e, REG_CODE_MAP, (int)operand.raw);
+            emit_exit_jump(e, CC_NE, exitPtr, false, ticks);
+        }
+        emit_page_lookup_disp(e, operand.raw, missing);
+    } else {
+        emit_relative_address(e, operand.raw, exitPtr, ticks);
+        emit_alu_imm(e, 7, REG_ADDRESS, (int)tape->codeLimit);
+        size_t pastCode = emit_forward_jump(e, CC_AE);
+        emit_cmp_byte_indexed(e, REG_CODE_MAP, REG_ADDRESS);
+        emit_exit_jump(e, CC_NE, exitPtr, false, ticks);
+        patch_forward_jump(e, pastCode);
+        emit_page_lookup_indexed(e, missing);
+    }
+
+    // Leaving through the missing-page jumps needs them to point at an exit stub.
+    for (int i = 0; i < 2; i++) {
+        JitExit *exit = &e->exits[e->exitCount++];
+        exit->patch = missing[i];
+        exit->ptr = exitPtr;
+        exit->dynamicPtr = false;
+        exit->ticks = ticks;
+    }
+    emit_cmp_dword_disp(e, REG_PAGE, offsetof(TapePage, refs), 1);
+    emit_exit_jump(e, CC_NE, exitPtr, false, ticks);
+
+    if (operand.mode == POSITION) {
+        long long offset = operand.raw & TAPE_PAGE_MASK;
+        emit_store_disp(e, REG_PAGE, PAGE_VALUES + (int)(offset * 8), RAX);
+        emit_clear_decoded_disp(e, REG_PAGE, PAGE_DECODED + (int)(offset * sizeof(DecodedInstruction)));
+    } else {
+        emit_store_indexed(e, REG_PAGE, REG_ADDRESS, PAGE_VALUES, RAX);
+        emit_clear_decoded_indexed(e, REG_PAGE, REG_ADDRESS, PAGE_DECODED);
+    }
+}
+
+// Emits one instruction, or returns false (leaving the emitter to be rolled back) if it can't be
+// compiled. 'index' is the number of instructions before this one in the block.
+static bool emit_instruction(Emitter *e, Tape *tape, long long addr, int index, long long start,
+                             size_t loopHead, bool *terminated) {
+    if (addr >= tape->codeLimit) {
+        return false;
+    }
+
+    DecodedInstruction instr = decode_instruction(tape_get(tape, addr));
+    int params = parameter_count(instr.opcode);
+    if (params < 0 || addr + params >= tape->codeLimit) {
+        return false;
+    }
+
+    Operand operands[3];
+    for (int i = 0; i < params; i++) {
+        operands[i].mode = instr.modes[i];
+        operands[i].raw = tape_get(tape, addr + 1 + i);
+        bool isDestination = (params == 3 && i == 2);
+        if (!operand_is_compilable(operands[i], isDestination)) {
+            return false;
+        }
+    }
+
+    switch (instr.opcode) {
+        case ADD:
+        case MULTIPLY:
+        case LESS_THAN:
+        case EQUALS:
+            emit_load_operand(e, RAX, operands[0], addr, index);
+            emit_load_operand(e, RCX, operands[1], addr, index);
+            if (instr.opcode == ADD) {
+                emit_alu(e, 0x01, RAX, RCX);
+            } else if (instr.opcode == MULTIPLY) {
+                emit_imul(e, RAX, RCX);
+            } else {
+                emit_alu(e, 0x39, RAX, RCX);
+                emit_set_rax(e, instr.opcode == LESS_THAN ? CC_L : CC_E);
+            }
+            emit_store_result(e, tape, operands[2], addr, index);
+            break;
+        case ADJUST_RELATIVE_BASE:
+            emit_load_operand(e, RAX, operands[0], addr, index);
+            emit_alu(e, 0x01, REG_RELATIVE_BASE, RAX);
+            break;
+        case JUMP_IF_TRUE:
+        case JUMP_IF_FALSE:
+            emit_load_operand(e, RAX, operands[0], addr, index);
+            emit_load_operand(e, RCX, operands[1], addr, index);
+            emit_alu(e, 0x85, RAX, RAX);
+            // Fall-through leaves the block.
+            emit_exit_jump(e, instr.opcode == JUMP_IF_TRUE ? CC_E : CC_NE, addr + 3, false, index + 1);
+            if (operands[1].mode == IMMEDIATE && operands[1].raw == start) {
+                // A jump back to the top of the block loops without leaving native code, unless
+                // another pass would take the machine past its instruction budget.
+                emit_add_mem_imm(e, REG_STATE, offsetof(State, ticks), index + 1);
+                emit_load_disp(e, RAX, REG_STATE, offsetof(State, ticks));
+                emit_add_imm(e, RAX, index + 1);
+                emit_cmp_disp(e, RAX, REG_STATE, offsetof(State, tickLimit));
+                emit_exit_jump(e, CC_G, start, false, 0);
+                emit_byte(e, 0xE9);
+                emit_u32(e, (unsigned int)(loopHead - (e->size + 4)));
+            } else {
+                emit_exit_inline(e, 0, true, index + 1);
+            }
+            *terminated = true;
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+bool jit_compile(Tape *tape, long long start) {
+    JitCache *jit = tape->jit;
+    Emitter *e = malloc(sizeof(Emitter));
+    e->size = 0;
+    e->exitCount = 0;
+
+    emit_prologue(e);
+    size_t loopHead = e->size;
+
+    long long addr = start;
+    int count = 0;
+    bool terminated = false;
+    while (count < JIT_MAX_BLOCK_INSTRUCTIONS && !terminated) {
+        size_t sizeMark = e->size;
+        int exitMark = e->exitCount;
+        if (!emit_instruction(e, tape, addr, count, start, loopHead, &terminated)) {
+            e->size = sizeMark;
+            e->exitCount = exitMark;
+            break;
+        }
+        addr += 1 + parameter_count(get_opcode(tape_get(tape, addr)));
+        count++;
+    }
+
+    if (count == 0) {
+        free(e);
+        return false;
+    }
+    if (!terminated) {
+        emit_exit_inline(e, addr, false, count);
+    }
+
+    for (int i = 0; i < e->exitCount; i++) {
+        JitExit *exit = &e->exits[i];
+        patch_u32(e, exit->patch, (unsigned int)(e->size - (exit->patch + 4)));
+        emit_exit_inline(e, exit->ptr, exit->dynamicPtr, exit->ticks);
+    }
+
+    if (jit->arenaUsed + e->size > JIT_ARENA_SIZE) {
+        // Out of room: start again from scratch rather than manage fragments.
+        jit_invalidate(tape, -1);
+    }
+
+    mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE);
+    unsigned char *code = jit->arena + jit->arenaUsed;
+    memcpy(code, e->code, e->size);
+    jit->arenaUsed += (e->size + 15) & ~(size_t)15;
+    mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC);
+    trace_info(TRACE_JIT, "Compiled %d instructions at %lld-%lld into %zu bytes.", count, start, addr, e->size);
+    free(e);
+
+    if (jit->blockCount == jit->blockCapacity) {
+        jit->blockCapacity *= 2;
+        jit->blocks = realloc(jit->blocks, sizeof(JitBlock) * jit->blockCapacity);
+    }
+    jit->blocks[jit->blockCount].start = start;
+    jit->blocks[jit->blockCount].end = addr;
+    jit->blockCount++;
+
+    // Pedantic C frowns on converting object pointers to function pointers; POSIX requires it to work.
+    *(void **)&jit->entries[start] = code;
+    jit->lengths[start] = count;
+    memset(tape->codeMap + start, 1, addr - start);
+    return true;
+}
+
+void jit_enter(State *state) {
+    Tape *tape = state->tape;
+    JitCache *jit = tape->jit;
+    if (jit == 0) {
+        jit = calloc(1, sizeof(JitCache));
+        if (jit == 0) {
+            return;
+        }
+        tape->jit = jit;
+    }
+    if (jit->arena == 0) {
+        // Colliding addresses only get hot a little sooner.
+        long long ptr = state->ptr;
+        if (jit->disabled || ptr < 0 || ++jit->warm[ptr % JIT_WARM_SLOTS] < JIT_HOT_THRESHOLD) {
+            return;
+        }
+        if (!jit_init(tape, jit)) {
+            jit->disabled = true;
+            return;
+        }
+        if (ptr < tape->codeLimit) {
+            jit->hotness[ptr] = JIT_HOT_THRESHOLD - 1; // So it's compiled straight away below.
+        }
+    }
+
+    while (is_running(state)) {
+        long long ptr = state->ptr;
+        if (ptr < 0 || ptr >= tape->codeLimit) {
+            return;
+        }
+
+        NativeBlock block = jit->entries[ptr];
+        if (block == 0) {
+            if (jit->strikes[ptr] >= JIT_MAX_STRIKES || ++jit->hotness[ptr] < JIT_HOT_THRESHOLD) {
+                return;
+            }
+            jit->hotness[ptr] = 0;
+            if (!jit_compile(tape, ptr)) {
+                jit->strikes[ptr] = JIT_MAX_STRIKES;
+                return;
+            }
+            block = jit->entries[ptr];
+        }
+        if (state->ticks + jit->lengths[ptr] > state->tickLimit) {
+            return;
+        }
+
+        block(state);
+        if (state->ptr == ptr) {
+            // A side exit on the first instruction; the interpreter has to take it from here.
+            return;
+        }
+    }
+}
+
+void jit_invalidate(Tape *tape, long long idx) {
+    JitCache *jit = tape->jit;
+    if (jit == 0 || jit->arena == 0) {
+        return;
+    }
+
+    for (int i = 0; i < jit->blockCount; i++) {
+        JitBlock *block = &jit->blocks[i];
+        if (idx >= block->start && idx < block->end && jit->strikes[block->start] < JIT_MAX_STRIKES) {
+            jit->strikes[block->start]++;
+        }
+    }
+    trace_info(TRACE_JIT, "Write to %lld invalidated %d blocks.", idx, jit->blockCount);
+
+    jit->blockCount = 0;
+    jit->arenaUsed = 0;
+    memset(jit->entries, 0, sizeof(NativeBlock) * tape->codeLimit);
+    memset(jit->hotness, 0, sizeof(unsigned short) * tape->codeLimit);
+    memset(tape->codeMap, 0, tape->codeLimit);
+}
+
+// Maps the arena and per-address tables once something on the tape is hot. On failure everything is
+// released again and the tape stays in the interpreter.
+static bool jit_init(Tape *tape, JitCache *jit) {
+    void *arena = mmap(0, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Could not map memory for the JIT; continuing in the interpreter.\n");
+        return false;
+    }
+
+    // Code is only compiled where the dense page directory reaches, so that data written far up the
+    // tape doesn't make these tables huge.
+    long long codeLimit = (tape->count + TAPE_PAGE_MASK) & ~TAPE_PAGE_MASK;
+    codeLimit = (codeLimit < TAPE_DENSE_PAGES * TAPE_PAGE_SIZE) ? codeLimit : TAPE_DENSE_PAGES * TAPE_PAGE_SIZE;
+    jit->arenaUsed = 0;
+    jit->blockCapacity = 16;
+    jit->blockCount = 0;
+    jit->blocks = malloc(sizeof(JitBlock) * jit->blockCapacity);
+    jit->entries = calloc(codeLimit, sizeof(NativeBlock));
+    jit->hotness = calloc(codeLimit, sizeof(unsigned short));
+    jit->strikes = calloc(codeLimit, 1);
+    jit->lengths = calloc(codeLimit, 1);
+    unsigned char *codeMap = calloc(codeLimit, 1);
+    if (jit->blocks == 0 || jit->entries == 0 || jit->hotness == 0 || jit->strikes == 0 || jit->lengths == 0
+        || codeMap == 0) {
+        fprintf(stderr, "ERROR: Could not allocate the JIT's tables; continuing in the interpreter.\n");
+        munmap(arena, JIT_ARENA_SIZE);
+        free(jit->blocks);
+        free(jit->entries);
+        free(jit->hotness);
+        free(jit->strikes);
+        free(jit->lengths);
+        free(codeMap);
+        return false;
+    }
+
+    jit->arena = arena;
+    tape->codeLimit = codeLimit;
+    tape->codeMap = codeMap;
+    return true;
+}
+
+void jit_free(Tape *tape) {
+    JitCache *jit = tape->jit;
+    if (jit == 0) {
+        return;
+    }
+
+    if (jit->arena != 0) {
+        munmap(jit->arena, JIT_ARENA_SIZE);
+        free(jit->blocks);
+        free(jit->entries);
+        free(jit->hotness);
+        free(jit->strikes);
+        free(jit->lengths);
+    }
+    free(jit);
+    free(tape->codeMap);
+    tape->jit = 0;
+    tape->codeMap = 0;
+    tape->codeLimit = 0;
+}
+
+#else
+
+// Without JIT support everything stays in the interpreter.
+void jit_enter(State *state) {
+}
+
+void jit_invalidate(Tape *tape, long long idx) {
+}
+
+void jit_free(Tape *tape) {
+}
+
+#endif
@@ -0,0 +1,260 @@
+#include <string.h>
+#include "intcode.h"
+
+// Tape text is split on separator bytes (commas and whitespace) 64 bytes at a time: each block is
+// classified into bitmasks with SIMD compares, then the separators are visited with ctz. Numbers of
+// up to 16 digits are converted eight digits at a time, with SSE4.1 multiply-adds where the target
+// has them and SWAR arithmetic otherwise. Define INTCODE_SCALAR_PARSE to use none of this.
+
+#if !defined(INTCODE_SCALAR_PARSE) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define PARSE_AVX2 1
+#elif !defined(INTCODE_SCALAR_PARSE) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define PARSE_SSE2 1
+#endif
+
+#if !defined(INTCODE_SCALAR_PARSE) && defined(__SSE4_1__)
+    #include <smmintrin.h>
+    #define PARSE_SSE41 1
+#endif
+
+#define BLOCK 64
+
+typedef struct {
+    unsigned long long separators;
+    unsigned long long minus;
+    unsigned long long invalid; // Neither a digit, a minus sign nor a separator.
+} BlockClasses;
+
+static inline bool is_separator(char c) {
+    return c == ',' || c == '\n' || c == ' ' || c == '\r' || c == '\t';
+}
+
+static void classify_scalar(const char *text, int length, BlockClasses *classes) {
+    classes->separators = 0;
+    classes->minus = 0;
+    classes->invalid = 0;
+    for (int i = 0; i < length; i++) {
+        unsigned long long bit = 1ULL << i;
+        char c = text[i];
+        if (is_separator(c)) {
+            classes->separators |= bit;
+        } else if (c == '-') {
+            classes->minus |= bit;
+        } else if (c < '0' || c > '9') {
+            classes->invalid |= bit;
+        }
+    }
+}
+
+#if defined(PARSE_AVX2)
+
+static inline unsigned long long mask_of(__m256i lo, __m256i hi) {
+    return (unsigned)_mm256_movemask_epi8(lo) | ((unsigned long long)(unsigned)_mm256_movemask_epi8(hi) << 32);
+}
+
+static inline __m256i separators_in(__m256i x) {
+    __m256i sep = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(',')),
+                                  _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+    sep = _mm256_or_si256(sep, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+    sep = _mm256_or_si256(sep, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r')));
+    return _mm256_or_si256(sep, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+}
+
+static inline __m256i digits_in(__m256i x) {
+    __m256i offset = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(9)), offset);
+}
+
+static void classify_block(const char *text, BlockClasses *classes) {
+    __m256i lo = _mm256_loadu_si256((const __m256i *)text);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(text + 32));
+    __m256i minus = _mm256_set1_epi8('-');
+    classes->separators = mask_of(separators_in(lo), separators_in(hi));
+    classes->minus = mask_of(_mm256_cmpeq_epi8(lo, minus), _mm256_cmpeq_epi8(hi, minus));
+    unsigned long long digits = mask_of(digits_in(lo), digits_in(hi));
+    classes->invalid = ~(classes->separators | classes->minus | digits);
+}
+
+#elif defined(PARSE_SSE2)
+
+static inline __m128i separators_in(__m128i x) {
+    __m128i sep = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(',')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+    sep = _mm_or_si128(sep, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+    sep = _mm_or_si128(sep, _mm_cmpeq_epi8(x, _mm_set1_epi8('\r')));
+    return _mm_or_si128(sep, _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+}
+
+static inline __m128i digits_in(__m128i x) {
+    __m128i offset = _mm_sub_epi8(x, _mm_set1_epi8('0'));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+}
+
+static void classify_block(const char *text, BlockClasses *classes) {
+    unsigned long long separators = 0, minus = 0, digits = 0;
+    for (int i = 0; i < BLOCK; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(text + i));
+        separators |= (unsigned long long)(unsigned)_mm_movemask_epi8(separators_in(x)) << i;
+        minus |= (unsigned long long)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('-'))) << i;
+        digits |= (unsigned long long)(unsigned)_mm_movemask_epi8(digits_in(x)) << i;
+    }
+    classes->separators = separators;
+    classes->minus = minus;
+    classes->invalid = ~(separators | minus | digits);
+}
+
+#else
+
+static void classify_block(const char *text, BlockClasses *classes) {
+    classify_scalar(text, BLOCK, classes);
+}
+
+#endif
+
+// The value of the length (1 to 8) digits ending just before end. Reads the eight bytes before end,
+// so there must be that many in the buffer.
+static inline long long eight_digits(const char *end, int length) {
+    int drop = 8 * (8 - length);
+#if defined(PARSE_SSE41)
+    __m128i chunk = _mm_loadl_epi64((const __m128i *)(end - 8));
+    chunk = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+    // Clear the bytes before the number, which are the low bytes of the little-endian lane.
+    __m128i shift = _mm_cvtsi32_si128(drop);
+    chunk = _mm_sll_epi64(_mm_srl_epi64(chunk, shift), shift);
+    __m128i pairs = _mm_maddubs_epi16(chunk, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+    __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    quads = _mm_packus_epi32(quads, quads);
+    __m128i eights = _mm_madd_epi16(quads, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+    return _mm_cvtsi128_si32(eights);
+#else
+    unsigned long long word;
+    memcpy(&word, end - 8, 8);
+    word = (word >> drop) << drop;
+    word -= (0x3030303030303030ULL >> drop) << drop;
+    word = (word * 10 + (word >> 8)) & 0x00FF00FF00FF00FFULL;
+    word = (word * 100 + (word >> 16)) & 0x0000FFFF0000FFFFULL;
+    word = (word * 10000 + (word >> 32)) & 0xFFFFFFFFULL;
+    return (long long)word;
+#endif
+}
+
+static inline long long digits_scalar(const char *digits, long long length) {
+    unsigned long long value = 0;
+    for (long long i = 0; i < length; i++) {
+        value = value * 10 + (digits[i] - '0');
+    }
+    return (long long)value;
+}
+
+// Converts the digits in [digits, end), where text is the start of the buffer.
+static inline long long convert_digits(const char *text, const char *digits, const char *end) {
+    long long length = end - digits;
+    if (length <= 8 && end - 8 >= text) {
+        return eight_digits(end, (int)length);
+    } else if (length <= 16 && end - 16 >= text) {
+        return eight_digits(end - 8, (int)length - 8) * 100000000LL + eight_digits(end, 8);
+    }
+    return digits_scalar(digits, length);
+}
+
+long long tape_text_capacity(const char *text, long long length) {
+    long long separators = 0;
+    long long i = 0;
+    BlockClasses classes;
+    for (; i + BLOCK <= length; i += BLOCK) {
+        classify_block(text + i, &classes);
+        separators += __builtin_popcountll(classes.separators);
+    }
+    classify_scalar(text + i, (int)(length - i), &classes);
+    return separators + __builtin_popcountll(classes.separators) + 1;
+}
+
+// Stores the number in [start, end) if it is one (an optional minus sign, then digits).
+static inline bool store_number(const char *text, long long start, long long end, long long *values,
+                                long long capacity, long long *count) {
+    bool negative = (text[start] == '-');
+    const char *digits = text + start + (negative ? 1 : 0);
+    if (digits == text + end || *count == capacity) {
+        return false;
+    }
+    long long value = convert_digits(text, digits, text + end);
+    values[(*count)++] = negative ? -value : value;
+    return true;
+}
+
+long long tape_text_parse(const char *text, long long length, long long *values, long long capacity, long long *end) {
+    long long count = 0;
+    long long start = 0; // Start of the number in progress.
+    bool afterSeparator = true; // Whether the byte before the current block was a separator.
+    for (long long block = 0; block < length; block += BLOCK) {
+        BlockClasses classes;
+        int blockLength = (length - block < BLOCK) ? (int)(length - block) : BLOCK;
+        if (blockLength == BLOCK) {
+            classify_block(text + block, &classes);
+        } else {
+            classify_scalar(text + block, blockLength, &classes);
+            classes.invalid &= (1ULL << blockLength) - 1;
+        }
+
+        // A minus sign is only valid at the start of a number.
+        unsigned long long numberStarts = (classes.separators << 1) | (afterSeparator ? 1 : 0);
+        unsigned long long invalid = classes.invalid | (classes.minus & ~numberStarts);
+        unsigned long long separators = classes.separators;
+        if (invalid != 0) {
+            separators &= (1ULL << __builtin_ctzll(invalid)) - 1;
+        }
+
+        while (separators != 0) {
+            long long at = block + __builtin_ctzll(separators);
+            separators &= separators - 1;
+            if (at > start && !store_number(text, start, at, values, capacity, &count)) {
+                *end = start;
+                return count;
+            }
+            start = at + 1;
+        }
+        if (invalid != 0) {
+            *end = block + __builtin_ctzll(invalid);
+            return count;
+        }
+        afterSeparator = (classes.separators >> (blockLength - 1)) & 1;
+    }
+
+    // The last number may run to the end of the text.
+    if (length > start && !store_number(text, start, length, values, capacity, &count)) {
+        *end = start;
+        return count;
+    }
+    *end = length;
+    return count;
+}
+
+long long tape_text_parse_scalar(const char *text, long long length, long long *values, long long capacity,
+                                 long long *end) {
+    long long count = 0;
+    long long i = 0;
+    while (i < length) {
+        if (is_separator(text[i])) {
+            i++;
+            continue;
+        }
+
+        bool negative = (text[i] == '-');
+        long long digitsEnd = i + (negative ? 1 : 0);
+        while (digitsEnd < length && text[digitsEnd] >= '0' && text[digitsEnd] <= '9') {
+            digitsEnd++;
+        }
+        if (digitsEnd < length && !is_separator(text[digitsEnd])) {
+            *end = digitsEnd;
+            return count;
+        }
+        if (!store_number(text, i, digitsEnd, values, capacity, &count)) {
+            *end = i;
+            return count;
+        }
+        i = digitsEnd;
+    }
+    *end = length;
+    return count;
+}
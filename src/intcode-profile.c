@@ -0,0 +1,133 @@
+#include <string.h>
+#include "intcode.h"
+
+#define INITIAL_PROFILE_CAPACITY 1024
+
+typedef struct {
+    long long address;
+    long long hits;
+} AddressCount;
+
+static const char *opcode_name(int opcode);
+static int compare_hits(const void *a, const void *b);
+
+Profile *profile_init() {
+    Profile *profile = calloc(1, sizeof(Profile));
+    profile_reserve(profile, INITIAL_PROFILE_CAPACITY - 1);
+    return profile;
+}
+
+void profile_free(Profile *profile) {
+    free(profile->hits);
+    free(profile->taken);
+    free(profile->opcodeAt);
+    free(profile);
+}
+
+void profile_reserve(Profile *profile, long long address) {
+    if (address < profile->capacity) {
+        return;
+    }
+    long long capacity = (profile->capacity > 0) ? profile->capacity : INITIAL_PROFILE_CAPACITY;
+    while (capacity <= address) {
+        capacity *= 2;
+    }
+
+    profile->hits = realloc(profile->hits, sizeof(long long) * capacity);
+    profile->taken = realloc(profile->taken, sizeof(long long) * capacity);
+    profile->opcodeAt = realloc(profile->opcodeAt, capacity);
+    long long added = capacity - profile->capacity;
+    memset(profile->hits + profile->capacity, 0, sizeof(long long) * added);
+    memset(profile->taken + profile->capacity, 0, sizeof(long long) * added);
+    memset(profile->opcodeAt + profile->capacity, 0, added);
+    profile->capacity = capacity;
+}
+
+void profile_report(Profile *profile, FILE *out, int hottest) {
+    double total = (profile->instructions > 0) ? profile->instructions : 1;
+    fprintf(out, "Profile: %lld instructions.\n", profile->instructions);
+    fprintf(out, "%-22s %14s %7s %14s %14s %14s\n", "Opcode", "Count", "%", "position", "immediate", "relative");
+    for (int opcode = 0; opcode < 100; opcode++) {
+        if (profile->opcodes[opcode] == 0) {
+            continue;
+        }
+        long long *modes = profile->modes[opcode];
+        fprintf(out, "%-22s %14lld %6.2f%% %14lld %14lld %14lld\n", opcode_name(opcode), profile->opcodes[opcode],
+                100 * profile->opcodes[opcode] / total, modes[POSITION], modes[IMMEDIATE], modes[RELATIVE]);
+    }
+
+    long long executed = 0;
+    for (long long i = 0; i < profile->capacity; i++) {
+        executed += (profile->hits[i] != 0);
+    }
+    AddressCount *counts = malloc(sizeof(AddressCount) * (executed + 1));
+    long long n = 0;
+    for (long long i = 0; i < profile->capacity; i++) {
+        if (profile->hits[i] != 0) {
+            counts[n].address = i;
+            counts[n].hits = profile->hits[i];
+            n++;
+        }
+    }
+    qsort(counts, n, sizeof(AddressCount), compare_hits);
+
+    long long shown = (hottest < 0 || hottest > n) ? n : hottest;
+    fprintf(out, "Hottest %lld of %lld executed addresses:\n", shown, n);
+    fprintf(out, "%10s %-22s %14s %7s %14s %14s\n", "Address", "Opcode", "Count", "%", "Taken", "Not taken");
+    for (long long i = 0; i < shown; i++) {
+        long long address = counts[i].address;
+        int opcode = profile->opcodeAt[address];
+        fprintf(out, "%10lld %-22s %14lld %6.2f%%", address, opcode_name(opcode), counts[i].hits,
+                100 * counts[i].hits / total);
+        if (opcode == JUMP_IF_TRUE || opcode == JUMP_IF_FALSE) {
+            fprintf(out, " %14lld %14lld", profile->taken[address], counts[i].hits - profile->taken[address]);
+        }
+        fprintf(out, "\n");
+    }
+    free(counts);
+}
+
+void profile_write_folded(Profile *profile, FILE *out, const char *root) {
+    for (long long i = 0; i < profile->capacity; i++) {
+        if (profile->hits[i] != 0) {
+            fprintf(out, "%s;%s;%lld %lld\n", root, opcode_name(profile->opcodeAt[i]), i, profile->hits[i]);
+        }
+    }
+}
+
+static const char *opcode_name(int opcode) {
+    switch (opcode) {
+        case ADD:
+            return "ADD";
+        case MULTIPLY:
+            return "MULTIPLY";
+        case INPUT:
+            return "INPUT";
+        case OUTPUT:
+            return "OUTPUT";
+        case JUMP_IF_TRUE:
+            return "JUMP_IF_TRUE";
+        case JUMP_IF_FALSE:
+            return "JUMP_IF_FALSE";
+        case LESS_THAN:
+            return "LESS_THAN";
+        case EQUALS:
+            return "EQUALS";
+        case ADJUST_RELATIVE_BASE:
+            return "ADJUST_RELATIVE_BASE";
+        case HALT:
+            return "HALT";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+// Descending by hits, then ascending by address.
+static int compare_hits(const void *a, const void *b) {
+    const AddressCount *x = a;
+    const AddressCount *y = b;
+    if (x->hits != y->hits) {
+        return (x->hits < y->hits) ? 1 : -1;
+    }
+    return (x->address > y->address) - (x->address < y->address);
+}
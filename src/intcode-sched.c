@@ -0,0 +1,430 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <time.h>
+#include "intcode.h"
+
+#include "debug.h"
+
+// Machines move between these states under their own lock. Only READY machines sit in a run
+// queue, and only RUNNING ones are on a worker, so a machine is never run twice at once.
+typedef enum { MACHINE_READY, MACHINE_RUNNING, MACHINE_PARKED, MACHINE_DONE } MachineState;
+
+typedef struct {
+    int id;
+    State *state;
+    OutputHandler write; // The host's output handler and context, called in turn by machine_write.
+    void *context;
+    pthread_mutex_t lock;
+    Queue *inbox;
+    long long peakDepth;
+    MachineState status;
+} Machine;
+
+// Each worker takes machines from the front of its own run queue and puts preempted ones on the
+// back; an idle worker steals from the front of someone else's.
+typedef struct {
+    pthread_mutex_t lock;
+    Queue *ready;
+    long long instructions;
+    long long slices;
+    long long steals;
+    long long parks;
+} Worker;
+
+struct Scheduler {
+    Machine **machines;
+    int machineCount;
+    int machineCapacity;
+    Worker *workers;
+    int workerCount;
+    long long timeSlice;
+    int active; // Machines READY or RUNNING; the run ends when this reaches zero.
+    int nextQueue; // Round-robin target for machines made ready off the worker threads.
+    // Idle workers sleep on wake rather than spinning. posted counts make_ready calls, so a worker
+    // that saw no work can tell whether any was queued since it looked.
+    pthread_mutex_t idleLock;
+    pthread_cond_t wake;
+    int sleepers;
+    unsigned int posted;
+    SchedulerStats totals;
+};
+
+typedef struct {
+    Scheduler *scheduler;
+    int index;
+} WorkerStart;
+
+static __thread int currentWorker = -1;
+
+static void make_ready(Scheduler *, int machine);
+static void set_status(Machine *, MachineState);
+static void retire(Scheduler *);
+static void *worker_main(void *);
+static bool machine_read(void *context, long long *value);
+static void machine_write(void *context, long long value);
+static double seconds_since(struct timespec *start);
+
+Scheduler *scheduler_init(int workers, long long timeSlice) {
+    Scheduler *scheduler = malloc(sizeof(Scheduler));
+    scheduler->machineCapacity = 16;
+    scheduler->machineCount = 0;
+    scheduler->machines = malloc(sizeof(Machine *) * scheduler->machineCapacity);
+    scheduler->workerCount = (workers < 1) ? 1 : workers;
+    scheduler->workers = malloc(sizeof(Worker) * scheduler->workerCount);
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        Worker *worker = &scheduler->workers[i];
+        pthread_mutex_init(&worker->lock, 0);
+        worker->ready = queue_init();
+        worker->instructions = 0;
+        worker->slices = 0;
+        worker->steals = 0;
+        worker->parks = 0;
+    }
+    scheduler->timeSlice = (timeSlice < 1) ? 1 : timeSlice;
+    scheduler->active = 0;
+    scheduler->nextQueue = 0;
+    pthread_mutex_init(&scheduler->idleLock, 0);
+    pthread_cond_init(&scheduler->wake, 0);
+    scheduler->sleepers = 0;
+    scheduler->posted = 0;
+    scheduler->totals.instructions = 0;
+    scheduler->totals.seconds = 0;
+    scheduler->totals.slices = 0;
+    scheduler->totals.steals = 0;
+    scheduler->totals.parks = 0;
+    return scheduler;
+}
+
+void scheduler_free(Scheduler *scheduler) {
+    for (int i = 0; i < scheduler->machineCount; i++) {
+        Machine *machine = scheduler->machines[i];
+        pthread_mutex_destroy(&machine->lock);
+        queue_free(machine->inbox);
+        free(machine);
+    }
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        pthread_mutex_destroy(&scheduler->workers[i].lock);
+        queue_free(scheduler->workers[i].ready);
+    }
+    pthread_mutex_destroy(&scheduler->idleLock);
+    pthread_cond_destroy(&scheduler->wake);
+    free(scheduler->machines);
+    free(scheduler->workers);
+    free(scheduler);
+}
+
+// Machines must be added while the scheduler isn't running.
+int scheduler_add(Scheduler *scheduler, State *state) {
+    if (scheduler->machineCount == scheduler->machineCapacity) {
+        scheduler->machineCapacity *= 2;
+        scheduler->machines = realloc(scheduler->machines, sizeof(Machine *) * scheduler->machineCapacity);
+    }
+
+    Machine *machine = malloc(sizeof(Machine));
+    machine->id = scheduler->machineCount;
+    machine->state = state;
+    pthread_mutex_init(&machine->lock, 0);
+    machine->inbox = queue_init();
+    machine->peakDepth = 0;
+    machine->status = MACHINE_READY;
+    scheduler->machines[scheduler->machineCount++] = machine;
+
+    machine->write = state->io.write;
+    machine->context = state->io.context;
+    state->io.read = machine_read;
+    state->io.write = machine_write;
+    state->io.context = machine;
+    state->io.yieldWhenEmpty = true;
+    if (state->status == NEEDS_INPUT) {
+        state->status = RUNNING;
+    }
+
+    if (is_running(state)) {
+        __atomic_add_fetch(&scheduler->active, 1, __ATOMIC_SEQ_CST);
+        make_ready(scheduler, machine->id);
+    } else {
+        machine->status = MACHINE_DONE;
+    }
+    return machine->id;
+}
+
+// The input handler of every scheduled machine.
+static bool machine_read(void *context, long long *value) {
+    Machine *machine = context;
+    pthread_mutex_lock(&machine->lock);
+    bool available = !queue_is_empty(machine->inbox);
+    if (available) {
+        *value = queue_retrieve(machine->inbox);
+    }
+    pthread_mutex_unlock(&machine->lock);
+    return available;
+}
+
+static void machine_write(void *context, long long value) {
+    Machine *machine = context;
+    machine->write(machine->context, value);
+}
+
+void scheduler_send(Scheduler *scheduler, int id, long long value) {
+    if (id < 0 || id >= scheduler->machineCount) {
+        fprintf(stderr, "ERROR: Message %lld sent to unknown machine %d.\n", value, id);
+        return;
+    }
+
+    Machine *machine = scheduler->machines[id];
+    pthread_mutex_lock(&machine->lock);
+    queue_append(machine->inbox, value);
+    if (machine->inbox->length > machine->peakDepth) {
+        machine->peakDepth = machine->inbox->length;
+    }
+    bool wake = (machine->status == MACHINE_PARKED);
+    if (wake) {
+        machine->status = MACHINE_READY;
+    }
+    pthread_mutex_unlock(&machine->lock);
+
+    if (wake) {
+        // Counted before it's queued, and while the sender (if it's a machine) still counts, so
+        // the active count can't touch zero while this machine has work.
+        __atomic_add_fetch(&scheduler->active, 1, __ATOMIC_SEQ_CST);
+        make_ready(scheduler, id);
+    }
+}
+
+// Queues a machine on the current worker if there is one, keeping a woken machine near the one
+// that woke it; otherwise the queues take turns.
+static void make_ready(Scheduler *scheduler, int id) {
+    int index = currentWorker;
+    if (index < 0 || index >= scheduler->workerCount) {
+        index = __atomic_fetch_add(&scheduler->nextQueue, 1, __ATOMIC_RELAXED) % scheduler->workerCount;
+    }
+
+    Worker *worker = &scheduler->workers[index];
+    pthread_mutex_lock(&worker->lock);
+    queue_append(worker->ready, id);
+    pthread_mutex_unlock(&worker->lock);
+
+    // Pairs with the sleeper count going up before posted is checked in wait_for_work: either the
+    // worker sees this post, or this sees the worker and wakes it.
+    __atomic_add_fetch(&scheduler->posted, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&scheduler->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&scheduler->idleLock);
+        pthread_cond_signal(&scheduler->wake);
+        pthread_mutex_unlock(&scheduler->idleLock);
+    }
+}
+
+// Takes a machine out of the active count, waking every idle worker to exit if it was the last.
+static void retire(Scheduler *scheduler) {
+    if (__atomic_sub_fetch(&scheduler->active, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&scheduler->idleLock);
+        pthread_cond_broadcast(&scheduler->wake);
+        pthread_mutex_unlock(&scheduler->idleLock);
+    }
+}
+
+// Sleeps until something is queued after seen was read from posted, or the run ends.
+static void wait_for_work(Scheduler *scheduler, unsigned int seen) {
+    pthread_mutex_lock(&scheduler->idleLock);
+    __atomic_add_fetch(&scheduler->sleepers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&scheduler->posted, __ATOMIC_SEQ_CST) == seen
+        && __atomic_load_n(&scheduler->active, __ATOMIC_SEQ_CST) != 0) {
+        pthread_cond_wait(&scheduler->wake, &scheduler->idleLock);
+    }
+    __atomic_sub_fetch(&scheduler->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&scheduler->idleLock);
+}
+
+// Status is only ever read or written under the machine's lock, since scheduler_send decides
+// whether to requeue a machine from it.
+static void set_status(Machine *machine, MachineState status) {
+    pthread_mutex_lock(&machine->lock);
+    machine->status = status;
+    pthread_mutex_unlock(&machine->lock);
+}
+
+static int take_ready(Worker *worker) {
+    int id = -1;
+    pthread_mutex_lock(&worker->lock);
+    if (!queue_is_empty(worker->ready)) {
+        id = (int)queue_retrieve(worker->ready);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return id;
+}
+
+static int find_work(Scheduler *scheduler, int index) {
+    Worker *self = &scheduler->workers[index];
+    int id = take_ready(self);
+    for (int i = 1; id < 0 && i < scheduler->workerCount; i++) {
+        id = take_ready(&scheduler->workers[(index + i) % scheduler->workerCount]);
+        if (id >= 0) {
+            self->steals++;
+        }
+    }
+    return id;
+}
+
+// Gives a machine one time slice. A slice may span several outputs, but ends as soon as the
+// machine needs input it hasn't got.
+static void run_slice(Scheduler *scheduler, Worker *worker, Machine *machine) {
+    State *state = machine->state;
+    set_status(machine, MACHINE_RUNNING);
+    long long start = state->ticks;
+    long long remaining = scheduler->timeSlice;
+    YieldReason reason;
+    do {
+        reason = run_for(state, remaining);
+        remaining = scheduler->timeSlice - (state->ticks - start);
+    } while (reason == YIELD_OUTPUT && remaining > 0);
+    worker->instructions += state->ticks - start;
+    worker->slices++;
+
+    switch (reason) {
+        case YIELD_BUDGET:
+        case YIELD_OUTPUT:
+            set_status(machine, MACHINE_READY);
+            make_ready(scheduler, machine->id);
+            return;
+        case YIELD_NEEDS_INPUT: {
+            // A message may have arrived since the read failed, in which case there's no need to park.
+            pthread_mutex_lock(&machine->lock);
+            bool park = queue_is_empty(machine->inbox);
+            machine->status = park ? MACHINE_PARKED : MACHINE_READY;
+            pthread_mutex_unlock(&machine->lock);
+            if (park) {
+                worker->parks++;
+                trace_trace(TRACE_SCHED, "Parked machine %d.", machine->id);
+                retire(scheduler);
+            } else {
+                make_ready(scheduler, machine->id);
+            }
+            return;
+        }
+        default:
+            set_status(machine, MACHINE_DONE);
+            trace_info(TRACE_SCHED, "Machine %d finished after %lld instructions.", machine->id, state->ticks);
+            retire(scheduler);
+            return;
+    }
+}
+
+static void *worker_main(void *context) {
+    WorkerStart *start = context;
+    Scheduler *scheduler = start->scheduler;
+    Worker *worker = &scheduler->workers[start->index];
+    currentWorker = start->index;
+
+    // A worker that keeps finding nothing sleeps until a machine is queued, rather than spinning.
+    int idle = 0;
+    while (1) {
+        unsigned int seen = __atomic_load_n(&scheduler->posted, __ATOMIC_SEQ_CST);
+        int id = find_work(scheduler, start->index);
+        if (id >= 0) {
+            run_slice(scheduler, worker, scheduler->machines[id]);
+            idle = 0;
+        } else if (__atomic_load_n(&scheduler->active, __ATOMIC_SEQ_CST) == 0) {
+            break;
+        } else if (++idle >= 64) {
+            idle = 0;
+            wait_for_work(scheduler, seen);
+        }
+    }
+
+    currentWorker = -1;
+    return 0;
+}
+
+void scheduler_run(Scheduler *scheduler) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // The calling thread works as worker 0.
+    WorkerStart starts[scheduler->workerCount];
+    pthread_t threads[scheduler->workerCount];
+    int started = 1;
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        starts[i].scheduler = scheduler;
+        starts[i].index = i;
+    }
+    while (started < scheduler->workerCount
+           && pthread_create(&threads[started], 0, worker_main, &starts[started]) == 0) {
+        started++;
+    }
+    if (started < scheduler->workerCount) {
+        // Queues without a thread are still drained by stealing.
+        fprintf(stderr, "ERROR: Could only start %d of %d scheduler workers.\n", started, scheduler->workerCount);
+    }
+    trace_info(TRACE_SCHED, "Running %d machines on %d workers.", scheduler->machineCount, started);
+    worker_main(&starts[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(threads[i], 0);
+    }
+
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        Worker *worker = &scheduler->workers[i];
+        scheduler->totals.instructions += worker->instructions;
+        scheduler->totals.slices += worker->slices;
+        scheduler->totals.steals += worker->steals;
+        scheduler->totals.parks += worker->parks;
+        worker->instructions = 0;
+        worker->slices = 0;
+        worker->steals = 0;
+        worker->parks = 0;
+    }
+    scheduler->totals.seconds += seconds_since(&start);
+}
+
+SchedulerStats scheduler_stats(Scheduler *scheduler) {
+    return scheduler->totals;
+}
+
+long long scheduler_queue_depth(Scheduler *scheduler, int id) {
+    Machine *machine = scheduler->machines[id];
+    pthread_mutex_lock(&machine->lock);
+    long long depth = machine->inbox->length;
+    pthread_mutex_unlock(&machine->lock);
+    return depth;
+}
+
+// Lists every machine's inbox if there are only a few; otherwise summarises them.
+void scheduler_print_stats(Scheduler *scheduler, FILE *out) {
+    SchedulerStats *totals = &scheduler->totals;
+    fprintf(out, "Scheduler: %d machines on %d workers ran %lld instructions in %.3fs (%.1f M instructions/s).\n",
+            scheduler->machineCount, scheduler->workerCount, totals->instructions, totals->seconds,
+            (totals->seconds > 0) ? totals->instructions / totals->seconds / 1e6 : 0.0);
+    fprintf(out, "Scheduler: %lld slices, %lld stolen, %lld parks.\n", totals->slices, totals->steals, totals->parks);
+
+    long long depthTotal = 0;
+    long long deepest = -1;
+    int deepestMachine = -1;
+    long long peak = 0;
+    int peakMachine = -1;
+    for (int i = 0; i < scheduler->machineCount; i++) {
+        long long depth = scheduler_queue_depth(scheduler, i);
+        Machine *machine = scheduler->machines[i];
+        if (scheduler->machineCount <= 16) {
+            fprintf(out, "  Machine %d: %lld queued (peak %lld), %lld instructions.\n",
+                    i, depth, machine->peakDepth, machine->state->ticks);
+        }
+        depthTotal += depth;
+        if (depth > deepest) {
+            deepest = depth;
+            deepestMachine = i;
+        }
+        if (machine->peakDepth > peak) {
+            peak = machine->peakDepth;
+            peakMachine = i;
+        }
+    }
+    if (scheduler->machineCount > 0) {
+        fprintf(out, "Queue depths: mean %.2f, deepest %lld (machine %d), peak %lld (machine %d).\n",
+                (double)depthTotal / scheduler->machineCount, deepest, deepestMachine, peak, peakMachine);
+    }
+}
+
+static double seconds_since(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
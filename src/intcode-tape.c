@@ -0,0 +1,38 @@
+#include <string.h>
+#include "intcode.h"
+
+// Converts a text tape into a tape image that tape_load can map instead of parsing, or checks an
+// existing image against its checksum.
+// Usage: intcode-tape <tape.txt> <out.tape>
+//        intcode-tape --check <file.tape>
+
+int main(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "--check") == 0) {
+        Tape *tape = tape_map(argv[2]);
+        if (tape == 0) {
+            return 1;
+        }
+        printf("%s: %lld cells, checksum OK.\n", argv[2], tape->count);
+        tape_free(tape);
+        return 0;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <tape.txt> <out.tape>\n       %s --check <file.tape>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    // Parsed directly rather than through tape_load, which would map the old image instead.
+    FILE *text = fopen(argv[1], "r");
+    if (text == 0) {
+        fprintf(stderr, "ERROR: Could not open tape file %s.\n", argv[1]);
+        return 1;
+    }
+    Tape *tape = tape_parse(text);
+    fclose(text);
+    if (tape == 0) {
+        return 1;
+    }
+    bool written = tape_write_image(tape, argv[2], argv[1]);
+    tape_free(tape);
+    return written ? 0 : 1;
+}
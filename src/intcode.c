@@ -0,0 +1,1272 @@
+#define _POSIX_C_SOURCE 200809L
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "intcode.h"
+
+#include "debug.h"
+
+#define MAX_NATIVE_PROGRAMS 16
+#define INITIAL_QUEUE_CAPACITY 16
+#define TAPE_READ_CHUNK 65536
+#define TAPE_PARSE_CHUNK 65536
+#define RUN_OUTPUT_BATCH 64
+
+static const NativeProgram *nativePrograms[MAX_NATIVE_PROGRAMS];
+static int nativeProgramCount = 0;
+static long long totalInstructions = 0; // Across every machine in the process.
+
+static inline long long max(long long a, long long b) {
+    return (a <= b) ? b : a;
+}
+
+static bool tape_matches(Tape *, const long long *image, long long length);
+static bool has_suffix(const char *path, const char *suffix);
+
+static inline void do_add(State *, DecodedInstruction);
+static inline void do_multiply(State *, DecodedInstruction);
+static inline void do_input(State *, DecodedInstruction);
+static inline void do_output(State *, DecodedInstruction);
+static inline void do_jump_if_true(State *, DecodedInstruction);
+static inline void do_jump_if_false(State *, DecodedInstruction);
+static inline void do_less_than(State *, DecodedInstruction);
+static inline void do_equals(State *, DecodedInstruction);
+static inline void do_adjust_relative_base(State *, DecodedInstruction);
+static inline void do_halt(State *, DecodedInstruction);
+static inline long long fetch_parameter(State *, AddressMode);
+static inline long long fetch_destination(State *, AddressMode);
+
+// The whole interpreter funnels through this one function so that both tick() and the
+// run loops get the handlers inlined into a single switch.
+static inline Opcode step_decoded(State *, DecodedInstruction);
+
+static inline Opcode step(State *state) {
+    trace_trace(TRACE_VM, "%p: tick %lld at %lld.", (void *)state, state->ticks, state->ptr);
+    DecodedInstruction instr = read_decoded_instruction(state);
+    state->ticks++;
+    return step_decoded(state, instr);
+}
+
+static inline Opcode step_decoded(State *state, DecodedInstruction instr) {
+    Opcode opcode = instr.opcode;
+    switch (opcode) {
+        case ADD:
+            do_add(state, instr);
+            break;
+        case MULTIPLY:
+            do_multiply(state, instr);
+            break;
+        case INPUT:
+            do_input(state, instr);
+            break;
+        case OUTPUT:
+            do_output(state, instr);
+            break;
+        case JUMP_IF_TRUE:
+            do_jump_if_true(state, instr);
+            break;
+        case JUMP_IF_FALSE:
+            do_jump_if_false(state, instr);
+            break;
+        case LESS_THAN:
+            do_less_than(state, instr);
+            break;
+        case EQUALS:
+            do_equals(state, instr);
+            break;
+        case ADJUST_RELATIVE_BASE:
+            do_adjust_relative_base(state, instr);
+            break;
+        case HALT:
+            do_halt(state, instr);
+            break;
+        default:
+            fprintf(stderr, "ERROR: Unknown opcode %d encountered in instruction %lld at address %lld.\n",
+                    opcode, tape_get(state->tape, state->ptr - 1), state->ptr - 1);
+            state->status = ERROR;
+    }
+    return opcode;
+}
+
+Opcode tick(State *state) {
+    return step(state);
+}
+
+#ifdef INTCODE_JIT
+    #define JIT_HOOK() jit_enter(state)
+#else
+    #define JIT_HOOK()
+#endif
+
+#ifdef INTCODE_THREADED_DISPATCH
+
+// Threaded dispatch: every handler jumps straight to the next one through a table of label
+// addresses (a GCC extension), giving each opcode its own indirect branch to predict.
+static void interpret(State *state, bool stopOnOutput) {
+    long long limit = state->tickLimit;
+    static void *handlers[100] = {
+        [0 ... 99] = &&unknown,
+        [ADD] = &&add,
+        [MULTIPLY] = &&multiply,
+        [INPUT] = &&input,
+        [OUTPUT] = &&output,
+        [JUMP_IF_TRUE] = &&jump_if_true,
+        [JUMP_IF_FALSE] = &&jump_if_false,
+        [LESS_THAN] = &&less_than,
+        [EQUALS] = &&equals,
+        [ADJUST_RELATIVE_BASE] = &&adjust_relative_base,
+        [HALT] = &&halt
+    };
+    DecodedInstruction instr;
+
+    #define DISPATCH() \
+        do { \
+            if (!is_running(state) || state->ticks >= limit) { \
+                return; \
+            } \
+            trace_trace(TRACE_VM, "%p: tick %lld at %lld.", (void *)state, state->ticks, state->ptr); \
+            instr = read_decoded_instruction(state); \
+            state->ticks++; \
+            if (instr.opcode < 0) { \
+                goto unknown; \
+            } \
+            goto *handlers[(int)instr.opcode]; \
+        } while (0)
+
+    DISPATCH();
+
+    add:
+        do_add(state, instr);
+        DISPATCH();
+    multiply:
+        do_multiply(state, instr);
+        DISPATCH();
+    input:
+        do_input(state, instr);
+        DISPATCH();
+    output:
+        do_output(state, instr);
+        if (stopOnOutput) {
+            return;
+        }
+        DISPATCH();
+    jump_if_true:
+        do_jump_if_true(state, instr);
+        JIT_HOOK();
+        DISPATCH();
+    jump_if_false:
+        do_jump_if_false(state, instr);
+        JIT_HOOK();
+        DISPATCH();
+    less_than:
+        do_less_than(state, instr);
+        DISPATCH();
+    equals:
+        do_equals(state, instr);
+        DISPATCH();
+    adjust_relative_base:
+        do_adjust_relative_base(state, instr);
+        DISPATCH();
+    halt:
+        do_halt(state, instr);
+        return;
+    unknown:
+        fprintf(stderr, "ERROR: Unknown opcode %d encountered in instruction %lld at address %lld.\n",
+                instr.opcode, tape_get(state->tape, state->ptr - 1), state->ptr - 1);
+        state->status = ERROR;
+        return;
+
+    #undef DISPATCH
+}
+
+#else
+
+// Portable dispatch through the switch in step().
+static void interpret(State *state, bool stopOnOutput) {
+    long long limit = state->tickLimit;
+    while (is_running(state) && state->ticks < limit) {
+        Opcode opcode = step(state);
+        if (opcode == OUTPUT && stopOnOutput) {
+            break;
+        } else if (opcode == JUMP_IF_TRUE || opcode == JUMP_IF_FALSE) {
+            JIT_HOOK();
+        }
+    }
+}
+
+#endif
+
+// A jump's condition, read without executing the jump. Bad addresses are left for the jump itself
+// to report.
+static long long jump_condition(State *state, long long at, AddressMode mode) {
+    long long raw = tape_get(state->tape, at + 1);
+    long long address = (mode == RELATIVE) ? state->relativeBase + raw : raw;
+    if (mode == IMMEDIATE) {
+        return raw;
+    }
+    return (address < 0) ? 0 : tape_get(state->tape, address);
+}
+
+// The switch loop again, counting each instruction into the state's profile as it goes.
+static void interpret_profiled(State *state, bool stopOnOutput) {
+    Profile *profile = state->profile;
+    long long limit = state->tickLimit;
+    while (is_running(state) && state->ticks < limit) {
+        long long at = state->ptr;
+        trace_trace(TRACE_VM, "%p: tick %lld at %lld.", (void *)state, state->ticks, at);
+        DecodedInstruction instr = read_decoded_instruction(state);
+        bool isJump = (instr.opcode == JUMP_IF_TRUE || instr.opcode == JUMP_IF_FALSE);
+        bool taken = isJump && (jump_condition(state, at, instr.modes[0]) != 0) == (instr.opcode == JUMP_IF_TRUE);
+        state->ticks++;
+        Opcode opcode = step_decoded(state, instr);
+        if (state->status == NEEDS_INPUT) {
+            break; // Not executed; it will be retried.
+        }
+
+        profile->instructions++;
+        if (opcode > 0 && opcode < 100) {
+            profile->opcodes[opcode]++;
+            for (int i = 0; i < parameter_count(opcode); i++) {
+                if (instr.modes[i] >= POSITION && instr.modes[i] <= RELATIVE) {
+                    profile->modes[opcode][(int)instr.modes[i]]++;
+                }
+            }
+        }
+        if (at >= 0) {
+            if (at >= profile->capacity) {
+                profile_reserve(profile, at);
+            }
+            profile->hits[at]++;
+            profile->opcodeAt[at] = instr.opcode;
+            if (taken) {
+                profile->taken[at]++;
+            }
+        }
+
+        if (opcode == OUTPUT && stopOnOutput) {
+            break;
+        }
+    }
+}
+
+static void dispatch(State *state, bool stopOnOutput) {
+    if (state->profile != 0) {
+        interpret_profiled(state, stopOnOutput);
+        return;
+    }
+
+    const NativeProgram *native = state->tape->native;
+    if (native != 0 && native->run(state, stopOnOutput)) {
+        return;
+    }
+
+    interpret(state, stopOnOutput);
+}
+
+static void execute(State *state, bool stopOnOutput) {
+    if (state->status == NEEDS_INPUT) {
+        state->status = RUNNING;
+    }
+
+    long long ticks = state->ticks;
+    dispatch(state, stopOnOutput);
+    __atomic_add_fetch(&totalInstructions, state->ticks - ticks, __ATOMIC_RELAXED);
+}
+
+long long intcode_instructions() {
+    return __atomic_load_n(&totalInstructions, __ATOMIC_RELAXED);
+}
+
+static void write_instruction_count() {
+    FILE *out = fopen(getenv("INTCODE_STATS_FILE"), "w");
+    if (out == 0) {
+        fprintf(stderr, "ERROR: Could not write the instruction count to %s.\n", getenv("INTCODE_STATS_FILE"));
+        return;
+    }
+    fprintf(out, "instructions %lld\n", intcode_instructions());
+    fclose(out);
+}
+
+// Lets a benchmark harness learn how much Intcode a process ran without changing its output.
+__attribute__((constructor)) static void report_instructions_at_exit() {
+    if (getenv("INTCODE_STATS_FILE") != 0) {
+        atexit(write_instruction_count);
+    }
+}
+
+void run(State *state) {
+    state->tickLimit = LLONG_MAX;
+    execute(state, false);
+
+    if (state->status == ERROR) {
+        fprintf(stderr, "ERROR: program %p exited with status ERROR.\n", state);
+    }
+}
+
+void run_until_output(State *state) {
+    state->tickLimit = LLONG_MAX;
+    execute(state, true);
+
+    if (state->status == ERROR) {
+        fprintf(stderr, "ERROR: program %p exited with status ERROR.\n", state);
+    }
+}
+
+Status run_batch(State *state, IoBatch *batch) {
+    if (state->status == NEEDS_INPUT) {
+        state->status = RUNNING;
+    }
+    state->tickLimit = LLONG_MAX;
+    while (is_running(state) && batch->outputLength < batch->outputCapacity) {
+        execute(state, true);
+    }
+
+    if (state->status == ERROR) {
+        fprintf(stderr, "ERROR: program %p exited with status ERROR.\n", state);
+    }
+    return state->status;
+}
+
+void run_with_inputs(State *state, int count, char **values) {
+    long long *inputs = malloc(sizeof(long long) * count);
+    for (int i = 0; i < count; i++) {
+        inputs[i] = atoll(values[i]);
+    }
+
+    long long outputs[RUN_OUTPUT_BATCH];
+    IoBatch batch = { inputs, count, 0, outputs, RUN_OUTPUT_BATCH, 0 };
+    state_use_batch(state, &batch);
+    do {
+        batch.outputLength = 0;
+        run_batch(state, &batch);
+        for (long long i = 0; i < batch.outputLength; i++) {
+            printf("Program outputted a value: %lld\n", outputs[i]);
+        }
+    } while (is_running(state));
+
+    if (state->status == NEEDS_INPUT) {
+        fprintf(stderr, "ERROR: Program %p wants more input than the %d value(s) given, at address %lld.\n",
+                state, count, state->ptr);
+    }
+    free(inputs);
+}
+
+YieldReason run_for(State *state, long long maxInstructions) {
+    long long outputs = state->outputs;
+    state->tickLimit = (maxInstructions > LLONG_MAX - state->ticks) ? LLONG_MAX : state->ticks + maxInstructions;
+    execute(state, true);
+
+    switch (state->status) {
+        case COMPLETE:
+            return YIELD_HALTED;
+        case NEEDS_INPUT:
+            return YIELD_NEEDS_INPUT;
+        case ERROR:
+            trace_error(TRACE_VM, "%p: failed at address %lld after %lld instructions.", (void *)state,
+                        state->ptr, state->ticks);
+            return YIELD_ERROR;
+        default:
+            return (state->outputs != outputs) ? YIELD_OUTPUT : YIELD_BUDGET;
+    }
+}
+
+void state_print_status(State *state) {
+    switch (state->status) {
+        case RUNNING:
+            printf("Program %p is still RUNNING.\n", state);
+            break;
+        case COMPLETE:
+            printf("Program %p exited with status COMPLETE.\n", state);
+            break;
+        case ERROR:
+            printf("Program %p exited with status ERROR.\n", state);
+            break;
+        case NEEDS_INPUT:
+            printf("Program %p is waiting for input.\n", state);
+            break;
+        default:
+            printf("Program %p exited with unknown status code %d.\n", state, state->status);
+    }
+}
+
+Instruction read_instruction(State *state) {
+    return read_next_value(state);
+}
+
+// Decoding goes through the tape's cache, so the divisions in get_opcode and
+// get_parameter_address_mode only happen the first time each address is executed.
+DecodedInstruction read_decoded_instruction(State *state) {
+    Tape *tape = state->tape;
+    long long ptr = state->ptr;
+    advance_pointer(state, 1);
+
+    TapePage *page = (ptr < 0) ? 0 : tape_page(tape, ptr);
+    if (page == 0) {
+        return decode_instruction(tape_get(tape, ptr));
+    }
+
+    DecodedInstruction *slot = &page->decoded[ptr & TAPE_PAGE_MASK];
+    if (slot->opcode == 0) {
+        // Shared pages may be in use on other threads, so they are never written, not even here.
+        DecodedInstruction instr = decode_instruction(page->values[ptr & TAPE_PAGE_MASK]);
+        if (__atomic_load_n(&page->refs, __ATOMIC_RELAXED) == 1) {
+            *slot = instr;
+        }
+        return instr;
+    }
+    return *slot;
+}
+
+DecodedInstruction decode_instruction(Instruction instr) {
+    DecodedInstruction decoded;
+    decoded.opcode = get_opcode(instr);
+    for (int i = 0; i < 3; i++) {
+        decoded.modes[i] = get_parameter_address_mode(instr, i + 1);
+    }
+    return decoded;
+}
+
+int parameter_count(Opcode opcode) {
+    switch (opcode) {
+        case ADD:
+        case MULTIPLY:
+        case LESS_THAN:
+        case EQUALS:
+            return 3;
+        case JUMP_IF_TRUE:
+        case JUMP_IF_FALSE:
+            return 2;
+        case INPUT:
+        case OUTPUT:
+        case ADJUST_RELATIVE_BASE:
+            return 1;
+        case HALT:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+Opcode get_opcode(Instruction instr) {
+    // The opcode is made up of the last two digits of the instruction.
+    return instr % 100;
+}
+
+static inline void do_add(State *state, DecodedInstruction instr) {
+    long long a = fetch_parameter(state, instr.modes[0]);
+    long long b = fetch_parameter(state, instr.modes[1]);
+    long long dst = fetch_destination(state, instr.modes[2]);
+    trace_trace(TRACE_VM, "%p: add %lld + %lld -> [%lld].", (void *)state, a, b, dst);
+    update_or_error(state, dst, a + b);
+}
+
+static inline void do_multiply(State *state, DecodedInstruction instr) {
+    long long a = fetch_parameter(state, instr.modes[0]);
+    long long b = fetch_parameter(state, instr.modes[1]);
+    long long dst = fetch_destination(state, instr.modes[2]);
+    trace_trace(TRACE_VM, "%p: multiply %lld * %lld -> [%lld].", (void *)state, a, b, dst);
+    update_or_error(state, dst, a * b);
+}
+
+static inline void do_input(State *state, DecodedInstruction instr) {
+    long long dst = fetch_destination(state, instr.modes[0]);
+    long long value;
+    if (!state->io.read(state->io.context, &value)) {
+        if (state->io.yieldWhenEmpty) {
+            // Back up to the start of the instruction so that resuming retries it.
+            state->ptr -= 2;
+            state->ticks--;
+            state->status = NEEDS_INPUT;
+            trace_trace(TRACE_IO, "%p: waiting for input at %lld.", (void *)state, state->ptr);
+            return;
+        }
+        fprintf(stderr, "ERROR: Input requested at address %lld, but none is available.\n", state->ptr);
+        state->status = ERROR;
+        return;
+    }
+    trace_trace(TRACE_IO, "%p: input %lld -> [%lld].", (void *)state, value, dst);
+    update_or_error(state, dst, value);
+}
+
+static inline void do_output(State *state, DecodedInstruction instr) {
+    long long value = fetch_parameter(state, instr.modes[0]);
+    state->outputs++;
+    trace_trace(TRACE_IO, "%p: output %lld.", (void *)state, value);
+    state->io.write(state->io.context, value);
+}
+
+static inline void do_jump_if_true(State *state, DecodedInstruction instr) {
+    long long conditional = fetch_parameter(state, instr.modes[0]);
+    long long new_ptr = fetch_parameter(state, instr.modes[1]);
+    trace_trace(TRACE_VM, "%p: jump to %lld if %lld is non-zero.", (void *)state, new_ptr, conditional);
+    if (conditional != 0) {
+        state->ptr = new_ptr;
+    }
+}
+
+static inline void do_jump_if_false(State *state, DecodedInstruction instr) {
+    long long conditional = fetch_parameter(state, instr.modes[0]);
+    long long new_ptr = fetch_parameter(state, instr.modes[1]);
+    trace_trace(TRACE_VM, "%p: jump to %lld if %lld is zero.", (void *)state, new_ptr, conditional);
+    if (conditional == 0) {
+        state->ptr = new_ptr;
+    }
+}
+
+static inline void do_less_than(State *state, DecodedInstruction instr) {
+    long long a = fetch_parameter(state, instr.modes[0]);
+    long long b = fetch_parameter(state, instr.modes[1]);
+    long long dst = fetch_destination(state, instr.modes[2]);
+    long long result = (a < b) ? 1 : 0;
+    trace_trace(TRACE_VM, "%p: %lld < %lld is %lld -> [%lld].", (void *)state, a, b, result, dst);
+    update_or_error(state, dst, result);
+}
+
+static inline void do_equals(State *state, DecodedInstruction instr) {
+    long long a = fetch_parameter(state, instr.modes[0]);
+    long long b = fetch_parameter(state, instr.modes[1]);
+    long long dst = fetch_destination(state, instr.modes[2]);
+    long long result = (a == b) ? 1 : 0;
+    trace_trace(TRACE_VM, "%p: %lld == %lld is %lld -> [%lld].", (void *)state, a, b, result, dst);
+    update_or_error(state, dst, result);
+}
+
+static inline void do_adjust_relative_base(State *state, DecodedInstruction instr) {
+    long long offset = fetch_parameter(state, instr.modes[0]);
+    state->relativeBase += offset;
+    trace_trace(TRACE_VM, "%p: relative base adjusted by %lld to %lld.", (void *)state, offset, state->relativeBase);
+}
+
+static inline void do_halt(State *state, DecodedInstruction instr) {
+    trace_trace(TRACE_VM, "%p: halt.", (void *)state);
+    state->status = COMPLETE;
+}
+
+long long load_parameter(State *state, Instruction instr, int paramIdx) {
+    return fetch_parameter(state, get_parameter_address_mode(instr, paramIdx));
+}
+
+long long load_destination(State *state, Instruction instr, int paramIdx) {
+    return fetch_destination(state, get_parameter_address_mode(instr, paramIdx));
+}
+
+static inline long long fetch_parameter(State *state, AddressMode addressMode) {
+    long long rawParam = read_next_value(state);
+    switch (addressMode) {
+        case POSITION:
+            // In POSITION mode, the tape value is a pointer to the location holding the parameter.
+            return tape_get(state->tape, rawParam);
+        case IMMEDIATE:
+            // In IMMEDIATE mode, the tape value is a literal.
+            return rawParam;
+        case RELATIVE:
+            // RELATIVE mode works like position, but the tape value is summed with the relative base to obtain a pointer to the parameter.
+            return tape_get(state->tape, state->relativeBase + rawParam);
+        default:
+            fprintf(stderr, "ERROR: Unknown address mode %d.\n", addressMode);
+            state->status = ERROR;
+            return 0;
+    }
+}
+
+static inline long long fetch_destination(State *state, AddressMode addressMode) {
+    long long destination = read_next_value(state);
+
+    switch (addressMode) {
+        case POSITION:
+            break;
+        case IMMEDIATE:
+            fprintf(stderr, "ERROR: A destination parameter had invalid address mode IMMEDIATE.\n");
+            state->status = ERROR;
+            break;
+        case RELATIVE:
+            destination += state->relativeBase;
+            break;
+        default:
+            fprintf(stderr, "ERROR: Unknown address mode %d.\n", addressMode);
+            state->status = ERROR;
+    }
+
+    return destination;
+}
+
+AddressMode get_parameter_address_mode(Instruction instr, int paramIdx) {
+    // The address mode for parameter 'i' is the digit with offset (i+2) from the right of the instruction.
+    instr /= 100;
+    for (int i = 1; i < paramIdx; i++) {
+        instr /= 10;
+    }
+    return instr % 10;
+}
+
+long long read_next_value(State *state) {
+    long long value = tape_get(state->tape, state->ptr);
+    advance_pointer(state, 1);
+    return value;
+}
+
+void update_or_error(State *state, long long dest, long long value) {
+    if (!tape_update(state->tape, dest, value)) {
+        fprintf(stderr, "ERROR: failed to update the tape.\n");
+        state->status = ERROR;
+    }
+}
+
+void advance_pointer(State *state, long long offset) {
+    state->ptr += offset;
+}
+
+State *state_init(Tape *tape) {
+    State *state = malloc(sizeof(State));
+    state->tape = tape;
+    state->ptr = 0;
+    state->relativeBase = 0;
+    state->status = RUNNING;
+    state->ticks = 0;
+    state->tickLimit = LLONG_MAX;
+    state->outputs = 0;
+    state->io.read = stdio_read;
+    state->io.write = stdio_write;
+    state->io.context = 0;
+    state->io.yieldWhenEmpty = false;
+    state->queues.input = 0;
+    state->queues.output = 0;
+    state->channels.input = 0;
+    state->channels.output = 0;
+    state->profile = 0;
+    return state;
+}
+
+void state_free(State *state) {
+    free(state);
+}
+
+State *state_clone(State *source, Tape *tape) {
+    State *state = malloc(sizeof(State));
+    *state = *source;
+    state->tape = tape;
+    state->profile = 0;
+    if (source->io.context == &source->queues) {
+        state->io.context = &state->queues;
+    } else if (source->io.context == &source->channels) {
+        state->io.context = &state->channels;
+    }
+    return state;
+}
+
+Snapshot *snapshot_take(State *source) {
+    Snapshot *snapshot = malloc(sizeof(Snapshot));
+    snapshot->tape = tape_clone(source->tape);
+    snapshot->state = state_clone(source, snapshot->tape);
+    return snapshot;
+}
+
+State *snapshot_restore(Snapshot *snapshot) {
+    return state_clone(snapshot->state, tape_clone(snapshot->tape));
+}
+
+void snapshot_free(Snapshot *snapshot) {
+    state_free(snapshot->state);
+    tape_free(snapshot->tape);
+    free(snapshot);
+}
+
+void state_use_queues(State *state, Queue *input, Queue *output) {
+    state->queues.input = input;
+    state->queues.output = output;
+    state->io.read = queue_read;
+    state->io.write = queue_write;
+    state->io.context = &state->queues;
+    state->io.yieldWhenEmpty = false;
+}
+
+void state_use_batch(State *state, IoBatch *batch) {
+    state->io.read = batch_read;
+    state->io.write = batch_write;
+    state->io.context = batch;
+    state->io.yieldWhenEmpty = true;
+}
+
+void state_use_channels(State *state, Channel *input, Channel *output) {
+    state->channels.input = input;
+    state->channels.output = output;
+    state->io.read = channel_read;
+    state->io.write = channel_write;
+    state->io.context = &state->channels;
+    state->io.yieldWhenEmpty = false;
+}
+
+bool is_running(State *state) {
+    return state->status == RUNNING;
+}
+
+bool stdio_read(void *context, long long *value) {
+    printf("Program requests input: ");
+    while (1) {
+        int read = scanf("%lld", value);
+        if (read == 1) {
+            return true;
+        } else if (read == EOF) {
+            return false;
+        }
+
+        // Discard the offending token so that we don't spin on it forever.
+        scanf("%*s");
+        printf("No value received. Try again: ");
+    }
+}
+
+void stdio_write(void *context, long long value) {
+    printf("Program outputted a value: %lld\n", value);
+}
+
+bool queue_read(void *context, long long *value) {
+    QueuePair *queues = context;
+    if (queue_is_empty(queues->input)) {
+        return false;
+    }
+
+    *value = queue_retrieve(queues->input);
+    return true;
+}
+
+void queue_write(void *context, long long value) {
+    QueuePair *queues = context;
+    if (!queue_append(queues->output, value)) {
+        fprintf(stderr, "ERROR: Output queue is full; dropping value %lld.\n", value);
+    }
+}
+
+bool batch_read(void *context, long long *value) {
+    IoBatch *batch = context;
+    if (batch->inputUsed >= batch->inputLength) {
+        return false;
+    }
+
+    *value = batch->input[batch->inputUsed++];
+    return true;
+}
+
+// run_batch stops as soon as the span fills, so this only overflows if the machine was run some
+// other way; that's reported rather than written past the end.
+void batch_write(void *context, long long value) {
+    IoBatch *batch = context;
+    if (batch->outputLength >= batch->outputCapacity) {
+        fprintf(stderr, "ERROR: Output span is full; dropping value %lld.\n", value);
+        return;
+    }
+    batch->output[batch->outputLength++] = value;
+}
+
+bool channel_read(void *context, long long *value) {
+    ChannelPair *channels = context;
+    return channel_receive(channels->input, value);
+}
+
+void channel_write(void *context, long long value) {
+    ChannelPair *channels = context;
+    channel_send(channels->output, value);
+}
+
+// Reads the whole stream, then parses it in one pass.
+Tape *tape_parse(FILE *f) {
+    size_t capacity = TAPE_READ_CHUNK;
+    size_t length = 0;
+    char *text = malloc(capacity);
+    size_t read;
+    while ((read = fread(text + length, 1, capacity - length, f)) > 0) {
+        length += read;
+        if (length == capacity) {
+            capacity *= 2;
+            text = realloc(text, capacity);
+        }
+    }
+
+    Tape *tape = tape_parse_text(text, length);
+    free(text);
+    return tape;
+}
+
+// Parses a chunk at a time into a small buffer, so a large tape never needs a second full-size copy
+// of its values. Chunks end just after a comma, so no number is split between two.
+Tape *tape_parse_text(const char *text, long long length) {
+    Tape *tape = tape_init();
+    long long capacity = TAPE_PARSE_CHUNK / 2 + 1;
+    long long *values = malloc(sizeof(long long) * capacity);
+    long long offset = 0;
+    while (offset < length) {
+        long long chunk = length - offset;
+        if (chunk > TAPE_PARSE_CHUNK) {
+            const char *comma = memchr(text + offset + TAPE_PARSE_CHUNK, ',', chunk - TAPE_PARSE_CHUNK);
+            chunk = (comma != 0) ? comma + 1 - (text + offset) : chunk;
+        }
+        if (chunk / 2 + 1 > capacity) {
+            capacity = chunk / 2 + 1;
+            values = realloc(values, sizeof(long long) * capacity);
+        }
+
+        long long end;
+        long long count = tape_text_parse(text + offset, chunk, values, capacity, &end);
+        tape_append_values(tape, values, count);
+        if (end < chunk) {
+            fprintf(stderr, "ERROR: Malformed tape text at offset %lld ('%c'); keeping the %lld values before it.\n",
+                    offset + end, text[offset + end], tape->count);
+            break;
+        }
+        offset += chunk;
+    }
+    free(values);
+    tape_match_native(tape);
+    return tape;
+}
+
+void tape_match_native(Tape *tape) {
+    for (int i = 0; i < nativeProgramCount; i++) {
+        const NativeProgram *native = nativePrograms[i];
+        if (native->length == tape->count && tape_matches(tape, native->image, native->length)) {
+            tape->native = native;
+            return;
+        }
+    }
+}
+
+static bool tape_matches(Tape *tape, const long long *image, long long length) {
+    for (long long start = 0; start < length; start += TAPE_PAGE_SIZE) {
+        TapePage *page = tape_page(tape, start);
+        long long cells = (length - start < TAPE_PAGE_SIZE) ? length - start : TAPE_PAGE_SIZE;
+        if (page == 0 || memcmp(page->values, image + start, sizeof(long long) * cells) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void native_register(const NativeProgram *native) {
+    if (nativeProgramCount == MAX_NATIVE_PROGRAMS) {
+        fprintf(stderr, "ERROR: Too many native programs registered; ignoring one.\n");
+        return;
+    }
+    nativePrograms[nativeProgramCount++] = native;
+}
+
+// Tape images (.tape files) are mapped as they are. A text tape foo.txt is replaced by foo.tape if
+// that image was made from this very text. Other regular files are mapped and parsed in place;
+// anything else is read through stdio.
+Tape *tape_load(const char *path) {
+    if (has_suffix(path, ".tape")) {
+        return tape_map(path);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Could not open tape file %s.\n", path);
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *text = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text != MAP_FAILED) {
+            posix_madvise(text, info.st_size, POSIX_MADV_SEQUENTIAL);
+            Tape *tape = tape_map_for_text(path, text, info.st_size);
+            if (tape == 0) {
+                tape = tape_parse_text(text, info.st_size);
+            }
+            munmap(text, info.st_size);
+            close(fd);
+            return tape;
+        }
+    }
+
+    FILE *f = fdopen(fd, "r");
+    Tape *tape = tape_parse(f);
+    fclose(f);
+    return tape;
+}
+
+static bool has_suffix(const char *path, const char *suffix) {
+    size_t length = strlen(path);
+    size_t suffixLength = strlen(suffix);
+    return length >= suffixLength && strcmp(path + length - suffixLength, suffix) == 0;
+}
+
+Tape *tape_clone(Tape *source) {
+    Tape *tape = malloc(sizeof(Tape));
+    tape->pageCount = source->pageCount;
+    tape->pages = malloc(sizeof(TapePage *) * tape->pageCount);
+    for (long long i = 0; i < tape->pageCount; i++) {
+        TapePage *page = source->pages[i];
+        if (page != 0) {
+            __atomic_add_fetch(&page->refs, 1, __ATOMIC_RELAXED);
+        }
+        tape->pages[i] = page;
+    }
+    tape->sparseCapacity = source->sparseCapacity;
+    tape->sparseCount = source->sparseCount;
+    tape->sparse = 0;
+    if (source->sparse != 0) {
+        tape->sparse = malloc(sizeof(TapeSparseSlot) * tape->sparseCapacity);
+        memcpy(tape->sparse, source->sparse, sizeof(TapeSparseSlot) * tape->sparseCapacity);
+        for (long long i = 0; i < tape->sparseCapacity; i++) {
+            if (tape->sparse[i].page != 0) {
+                __atomic_add_fetch(&tape->sparse[i].page->refs, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    tape->count = source->count;
+    tape->jit = 0;
+    tape->codeMap = 0;
+    tape->codeLimit = 0;
+    tape->native = source->native;
+    return tape;
+}
+
+Tape *tape_init() {
+    Tape *tape = malloc(sizeof(Tape));
+    tape->pageCount = 1;
+    tape->pages = calloc(tape->pageCount, sizeof(TapePage *));
+    tape->sparse = 0;
+    tape->sparseCapacity = 0;
+    tape->sparseCount = 0;
+    tape->count = 0;
+    tape->jit = 0;
+    tape->codeMap = 0;
+    tape->codeLimit = 0;
+    tape->native = 0;
+    return tape;
+}
+
+static void page_release(TapePage *page) {
+    if (page != 0 && __atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(page);
+    }
+}
+
+void tape_free(Tape *tape) {
+    jit_free(tape);
+    for (long long i = 0; i < tape->pageCount; i++) {
+        page_release(tape->pages[i]);
+    }
+    for (long long i = 0; i < tape->sparseCapacity; i++) {
+        page_release(tape->sparse[i].page);
+    }
+    free(tape->pages);
+    free(tape->sparse);
+    free(tape);
+}
+
+// Grows the dense page directory (but no pages) to cover the given number of cells, or as many of
+// them as it can hold.
+bool tape_ensure_capacity(Tape *tape, long long newCapacity) {
+    long long pagesNeeded = (newCapacity + TAPE_PAGE_MASK) >> TAPE_PAGE_BITS;
+    pagesNeeded = (pagesNeeded < TAPE_DENSE_PAGES) ? pagesNeeded : TAPE_DENSE_PAGES;
+    if (pagesNeeded <= tape->pageCount) {
+        return true;
+    }
+
+    long long oldCount = tape->pageCount;
+    long long newCount = oldCount;
+    while (newCount < pagesNeeded) {
+        newCount *= 2;
+    }
+    TapePage **pages = realloc(tape->pages, sizeof(TapePage *) * newCount);
+    if (pages == 0) {
+        fprintf(stderr, "ERROR: Could not grow the tape's page directory to %lld pages.\n", newCount);
+        return false;
+    }
+    memset(pages + oldCount, 0, sizeof(TapePage *) * (newCount - oldCount));
+    tape->pages = pages;
+    tape->pageCount = newCount;
+    return true;
+}
+
+static inline unsigned long long sparse_hash(long long pageIdx) {
+    unsigned long long hash = (unsigned long long)pageIdx * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 32);
+}
+
+// The slot holding the page, or the empty slot where it would go.
+static TapeSparseSlot *sparse_find(TapeSparseSlot *slots, long long capacity, long long pageIdx) {
+    unsigned long long mask = capacity - 1;
+    for (unsigned long long i = sparse_hash(pageIdx) & mask;; i = (i + 1) & mask) {
+        if (slots[i].index == pageIdx || slots[i].index < 0) {
+            return &slots[i];
+        }
+    }
+}
+
+static bool sparse_grow(Tape *tape) {
+    long long capacity = (tape->sparseCapacity == 0) ? 16 : tape->sparseCapacity * 2;
+    TapeSparseSlot *slots = malloc(sizeof(TapeSparseSlot) * capacity);
+    if (slots == 0) {
+        fprintf(stderr, "ERROR: Could not grow the tape's table of high pages to %lld slots.\n", capacity);
+        return false;
+    }
+    for (long long i = 0; i < capacity; i++) {
+        slots[i].index = -1;
+        slots[i].page = 0;
+    }
+    for (long long i = 0; i < tape->sparseCapacity; i++) {
+        if (tape->sparse[i].index >= 0) {
+            *sparse_find(slots, capacity, tape->sparse[i].index) = tape->sparse[i];
+        }
+    }
+    free(tape->sparse);
+    tape->sparse = slots;
+    tape->sparseCapacity = capacity;
+    return true;
+}
+
+TapePage *tape_page(Tape *tape, long long idx) {
+    long long pageIdx = idx >> TAPE_PAGE_BITS;
+    if (pageIdx < tape->pageCount) {
+        return tape->pages[pageIdx];
+    } else if (tape->sparse == 0 || pageIdx < TAPE_DENSE_PAGES) {
+        return 0;
+    }
+    return sparse_find(tape->sparse, tape->sparseCapacity, pageIdx)->page;
+}
+
+TapePage **tape_page_slot(Tape *tape, long long pageIdx) {
+    if (pageIdx < TAPE_DENSE_PAGES) {
+        return tape_ensure_capacity(tape, (pageIdx + 1) << TAPE_PAGE_BITS) ? &tape->pages[pageIdx] : 0;
+    }
+
+    if (tape->sparse != 0) {
+        TapeSparseSlot *slot = sparse_find(tape->sparse, tape->sparseCapacity, pageIdx);
+        if (slot->index == pageIdx) {
+            return &slot->page;
+        }
+    }
+    if ((tape->sparseCount + 1) * 2 > tape->sparseCapacity && !sparse_grow(tape)) {
+        return 0;
+    }
+    TapeSparseSlot *slot = sparse_find(tape->sparse, tape->sparseCapacity, pageIdx);
+    slot->index = pageIdx;
+    tape->sparseCount++;
+    return &slot->page;
+}
+
+TapePage *tape_page_for_write(Tape *tape, long long idx) {
+    TapePage **slot = tape_page_slot(tape, idx >> TAPE_PAGE_BITS);
+    if (slot == 0) {
+        return 0;
+    }
+    TapePage *page = *slot;
+    if (page == 0) {
+        page = calloc(1, sizeof(TapePage));
+        if (page == 0) {
+            fprintf(stderr, "ERROR: Could not allocate the tape page for address %lld.\n", idx);
+            return 0;
+        }
+        page->refs = 1;
+        *slot = page;
+    } else if (__atomic_load_n(&page->refs, __ATOMIC_ACQUIRE) > 1) {
+        TapePage *copy = malloc(sizeof(TapePage));
+        if (copy == 0) {
+            fprintf(stderr, "ERROR: Could not copy the shared tape page for address %lld.\n", idx);
+            return 0;
+        }
+        memcpy(copy, page, sizeof(TapePage));
+        copy->refs = 1;
+        page_release(page);
+        page = copy;
+        *slot = page;
+    }
+    return page;
+}
+
+void tape_append(Tape *tape, long long value) {
+    tape_update(tape, tape->count, value);
+}
+
+// Copies whole runs into each page, unless the tape has native code that a write might invalidate.
+void tape_append_values(Tape *tape, const long long *values, long long count) {
+    if (tape->codeMap != 0 || tape->native != 0) {
+        for (long long i = 0; i < count; i++) {
+            tape_append(tape, values[i]);
+        }
+        return;
+    }
+
+    long long idx = tape->count;
+    tape_ensure_capacity(tape, idx + count);
+    while (count > 0) {
+        TapePage *page = tape_page_for_write(tape, idx);
+        if (page == 0) {
+            break;
+        }
+        long long offset = idx & TAPE_PAGE_MASK;
+        long long cells = (TAPE_PAGE_SIZE - offset < count) ? TAPE_PAGE_SIZE - offset : count;
+        memcpy(page->values + offset, values, sizeof(long long) * cells);
+        memset(page->decoded + offset, 0, sizeof(DecodedInstruction) * cells);
+        idx += cells;
+        values += cells;
+        count -= cells;
+    }
+    tape->count = max(tape->count, idx);
+}
+
+long long tape_get(Tape *tape, long long idx) {
+    if (idx < 0) {
+        fprintf(stderr, "ERROR: Attempt to read negative index %lld from tape.\n", idx);
+        return 0;
+    }
+
+    // Memory that was never written reads as zero, so there's no need to allocate it.
+    TapePage *page = tape_page(tape, idx);
+    if (page == 0) {
+        return 0;
+    }
+    return page->values[idx & TAPE_PAGE_MASK];
+}
+
+bool tape_update(Tape *tape, long long idx, long long value) {
+    if (idx < 0) {
+        fprintf(stderr, "ERROR: Attempt to write negative index %lld on tape.\n", idx);
+        return false;
+    }
+
+    TapePage *page = tape_page_for_write(tape, idx);
+    if (page == 0) {
+        return false;
+    }
+    page->values[idx & TAPE_PAGE_MASK] = value;
+    page->decoded[idx & TAPE_PAGE_MASK].opcode = 0;
+    if (idx < tape->codeLimit && tape->codeMap[idx] != 0) {
+        jit_invalidate(tape, idx);
+    }
+    if (tape->native != 0 && idx < tape->native->length && tape->native->codeCells[idx] != 0) {
+        tape->native = 0;
+    }
+    tape->count = max(tape->count, idx + 1);
+    return true;
+}
+
+Queue *queue_init() {
+    Queue *queue = queue_init_fixed(INITIAL_QUEUE_CAPACITY);
+    queue->fixed = false;
+    return queue;
+}
+
+Queue *queue_init_fixed(long long capacity) {
+    long long size = 1;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    Queue *queue = malloc(sizeof(Queue));
+    queue->values = malloc(sizeof(long long) * size);
+    queue->capacity = size;
+    queue->head = 0;
+    queue->length = 0;
+    queue->fixed = true;
+    return queue;
+}
+
+void queue_free(Queue *queue) {
+    free(queue->values);
+    free(queue);
+}
+
+long long queue_retrieve(Queue *queue) {
+    if (queue->length == 0) {
+        fprintf(stderr, "ERROR: Attempt to retrieve a value from an empty queue.\n");
+        return 0;
+    }
+
+    long long result = queue->values[queue->head];
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    queue->length--;
+    return result;
+}
+
+bool queue_append(Queue *queue, long long value) {
+    if (queue->length == queue->capacity) {
+        if (queue->fixed) {
+            return false;
+        }
+
+        // Unwrap the values into the bottom of the doubled buffer.
+        long long *values = malloc(sizeof(long long) * queue->capacity * 2);
+        long long firstPart = queue->capacity - queue->head;
+        memcpy(values, queue->values + queue->head, sizeof(long long) * firstPart);
+        memcpy(values + firstPart, queue->values, sizeof(long long) * queue->head);
+        free(queue->values);
+        queue->values = values;
+        queue->head = 0;
+        queue->capacity *= 2;
+    }
+
+    queue->values[(queue->head + queue->length) & (queue->capacity - 1)] = value;
+    queue->length++;
+    return true;
+}
+
+bool queue_is_empty(Queue *queue) {
+    return queue->length == 0;
+}
+
+Channel *channel_init(unsigned long long capacity) {
+    unsigned long long size = 1;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    Channel *channel = malloc(sizeof(Channel));
+    channel->values = malloc(sizeof(long long) * size);
+    channel->mask = size - 1;
+    channel->head = 0;
+    channel->tail = 0;
+    channel->closed = false;
+    return channel;
+}
+
+void channel_free(Channel *channel) {
+    free(channel->values);
+    free(channel);
+}
+
+// Spins briefly, then gives up the core; the other end may be waiting for this thread's CPU.
+static void channel_wait(int *spins) {
+    if (++*spins >= 64) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+void channel_send(Channel *channel, long long value) {
+    unsigned long long tail = channel->tail;
+    int spins = 0;
+    while (tail - __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE) > channel->mask) {
+        channel_wait(&spins);
+    }
+
+    channel->values[tail & channel->mask] = value;
+    __atomic_store_n(&channel->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+bool channel_receive(Channel *channel, long long *value) {
+    unsigned long long head = channel->head;
+    int spins = 0;
+    while (__atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE) == head) {
+        // Closing happens after the final send, so re-check for values once it's seen.
+        if (__atomic_load_n(&channel->closed, __ATOMIC_ACQUIRE)
+                && __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE) == head) {
+            return false;
+        }
+        channel_wait(&spins);
+    }
+
+    *value = channel->values[head & channel->mask];
+    __atomic_store_n(&channel->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void channel_close(Channel *channel) {
+    __atomic_store_n(&channel->closed, true, __ATOMIC_RELEASE);
+}
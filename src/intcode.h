@@ -0,0 +1,331 @@
+#ifndef INTCODE_H
+#define INTCODE_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Pre-decoded form of the instruction at one tape address, so that the opcode and address modes
+// are only derived (by division) the first time the address is executed. An opcode of zero marks
+// an empty slot; writing to an address clears its slot, since operands are always read live.
+typedef struct {
+    signed char opcode;
+    signed char modes[3];
+} DecodedInstruction;
+
+// Compiled native code for hot blocks of a tape; private to intcode-jit.c.
+typedef struct JitCache JitCache;
+
+// An ahead-of-time translation of a specific program; see below.
+typedef struct NativeProgram NativeProgram;
+
+#define TAPE_PAGE_BITS 10
+#define TAPE_PAGE_SIZE (1LL << TAPE_PAGE_BITS)
+#define TAPE_PAGE_MASK (TAPE_PAGE_SIZE - 1)
+
+// Tapes are stored in fixed-size pages which are only allocated once written, so a sparse program
+// costs memory in proportion to the pages it touches. Cloned tapes share pages; a shared page is
+// copied the first time one of its tapes writes to it.
+typedef struct {
+    int refs; // Tapes using this page. Only a page with a single reference may be written.
+    long long values[TAPE_PAGE_SIZE];
+    DecodedInstruction decoded[TAPE_PAGE_SIZE];
+} TapePage;
+
+// Pages below TAPE_DENSE_PAGES are found through a flat directory, which grows to cover the highest
+// of them written; native code looks pages up there directly. Pages above it live in a hash table
+// keyed by page number, so a write to a huge address costs one page and one table slot.
+#define TAPE_DENSE_PAGES 1024
+
+typedef struct {
+    long long index; // Page number, or -1 if the slot is empty.
+    TapePage *page;
+} TapeSparseSlot;
+
+typedef struct {
+    TapePage **pages; // Null pages read as zero.
+    long long pageCount; // Length of pages; never more than TAPE_DENSE_PAGES.
+    TapeSparseSlot *sparse; // Open-addressed, at most half full; null until a high page is written.
+    long long sparseCapacity; // A power of two, or zero.
+    long long sparseCount;
+    long long count; // One past the highest address loaded or written.
+    JitCache *jit; // Null until the first taken jump; only counts jumps until something gets hot.
+    unsigned char *codeMap; // Non-zero where compiled code lives, for addresses below codeLimit.
+    long long codeLimit;
+    const NativeProgram *native; // Set if the tape was parsed from a translated program and is unmodified.
+} Tape;
+
+Tape *tape_init();
+void tape_free(Tape *);
+Tape *tape_parse(FILE *);
+Tape *tape_load(const char *path);
+Tape *tape_parse_text(const char *text, long long length); // Comma-separated values, as in a tape file.
+// Tape images (intcode-image.c): a tape's pages written out as they are in memory, so that mapping
+// the file gives a ready Tape without parsing. Images are only readable by builds with the same page
+// layout, and are checked against a checksum of their pages whenever they are mapped. An image can
+// record the text it was made from (sourcePath may be null), in which case tape_map_for_text maps
+// it in place of exactly that text: same size, mtime and contents.
+bool tape_write_image(Tape *, const char *path, const char *sourcePath);
+Tape *tape_map(const char *path);
+Tape *tape_map_for_text(const char *textPath, const char *text, long long length); // Null if there's no such image.
+void tape_match_native(Tape *); // Points the tape at a registered translation of its contents, if any.
+Tape *tape_clone(Tape *); // Shares pages with the source; takes no JIT code with it.
+bool tape_ensure_capacity(Tape *, long long); // False if memory ran out.
+void tape_append(Tape *, long long);
+void tape_append_values(Tape *, const long long *values, long long count);
+long long tape_get(Tape *, long long);
+bool tape_update(Tape *tape, long long idx, long long value);
+TapePage *tape_page(Tape *, long long idx); // Null if the page holding idx was never written.
+TapePage *tape_page_for_write(Tape *, long long idx); // Allocates or unshares the page as needed; null if memory ran out.
+TapePage **tape_page_slot(Tape *, long long pageIdx); // The directory entry for a page, made if need be; null if memory ran out.
+
+// A FIFO of values held in a ring buffer, so that steady traffic never touches the allocator.
+// The buffer doubles when full, unless the queue was made with a fixed capacity.
+typedef struct {
+    long long *values;
+    long long capacity; // A power of two.
+    long long head; // Index of the oldest value.
+    long long length;
+    bool fixed;
+} Queue;
+
+Queue *queue_init();
+Queue *queue_init_fixed(long long capacity); // Rounded up to a power of two.
+void queue_free(Queue *);
+long long queue_retrieve(Queue *);
+bool queue_append(Queue *, long long); // Only fails if a fixed-capacity queue is full.
+bool queue_is_empty(Queue *);
+
+// Tape text parsing (intcode-parse.c). Values are separated by commas or whitespace. The parser
+// finds separators and converts digits with SIMD where the target supports it (unless built with
+// INTCODE_SCALAR_PARSE); tape_text_parse_scalar is the plain version, for comparison.
+long long tape_text_capacity(const char *text, long long length); // At least the number of values.
+// Both return how many values were stored, and set *end to the offset where parsing stopped: the
+// length, unless the text is malformed there or holds more than capacity values.
+long long tape_text_parse(const char *text, long long length, long long *values, long long capacity, long long *end);
+long long tape_text_parse_scalar(const char *text, long long length, long long *values, long long capacity,
+                                 long long *end);
+
+#define CHANNEL_CACHE_LINE 64
+
+// A bounded, lock-free queue between exactly one producer thread and one consumer thread. Each
+// index is only ever written by one side, and they live on separate cache lines so the two threads
+// don't contend for them. Senders block while the channel is full and receivers while it's empty.
+typedef struct {
+    long long *values;
+    unsigned long long mask; // Capacity - 1; the capacity is a power of two.
+    char pad0[CHANNEL_CACHE_LINE];
+    unsigned long long head; // Next slot to receive from; written by the consumer.
+    char pad1[CHANNEL_CACHE_LINE];
+    unsigned long long tail; // Next slot to send to; written by the producer.
+    char pad2[CHANNEL_CACHE_LINE];
+    bool closed; // Set by the producer once it will send no more.
+} Channel;
+
+Channel *channel_init(unsigned long long capacity); // Rounded up to a power of two.
+void channel_free(Channel *);
+void channel_send(Channel *, long long);
+bool channel_receive(Channel *, long long *); // False once the channel is closed and drained.
+void channel_close(Channel *);
+
+typedef enum { POSITION, IMMEDIATE, RELATIVE } AddressMode;
+
+typedef long long Instruction;
+
+typedef enum {
+    ADD = 1,
+    MULTIPLY = 2,
+    INPUT = 3,
+    OUTPUT = 4,
+    JUMP_IF_TRUE = 5,
+    JUMP_IF_FALSE = 6,
+    LESS_THAN = 7,
+    EQUALS = 8,
+    ADJUST_RELATIVE_BASE = 9,
+    HALT = 99
+} Opcode;
+
+Opcode get_opcode(Instruction instruction);
+AddressMode get_parameter_address_mode(Instruction instruction, int paramIndex);
+DecodedInstruction decode_instruction(Instruction instruction);
+int parameter_count(Opcode); // -1 if it isn't an opcode.
+
+// NEEDS_INPUT pauses a machine at an INPUT instruction (see IoDevice.yieldWhenEmpty); running it
+// again retries the instruction.
+typedef enum { RUNNING, COMPLETE, ERROR, NEEDS_INPUT } Status;
+
+// I/O is delegated to the host through a pair of callbacks sharing one context.
+// An input handler returns false if it has no value to give, which halts the machine with ERROR,
+// or pauses it with NEEDS_INPUT if the device allows it.
+typedef bool (*InputHandler)(void *context, long long *value);
+typedef void (*OutputHandler)(void *context, long long value);
+
+typedef struct {
+    InputHandler read;
+    OutputHandler write;
+    void *context;
+    bool yieldWhenEmpty;
+} IoDevice;
+
+bool stdio_read(void *context, long long *value);
+void stdio_write(void *context, long long value);
+
+typedef struct {
+    Queue *input;
+    Queue *output;
+} QueuePair;
+
+bool queue_read(void *context, long long *value); // context is a QueuePair
+void queue_write(void *context, long long value); // context is a QueuePair
+
+typedef struct {
+    Channel *input;
+    Channel *output;
+} ChannelPair;
+
+bool channel_read(void *context, long long *value); // context is a ChannelPair
+void channel_write(void *context, long long value); // context is a ChannelPair
+
+// Batched I/O: the machine reads from a span of input and writes to a span of output, both owned
+// by the host, and pauses with NEEDS_INPUT when the input runs out. A host refills the spans
+// between calls to run_batch (resetting inputUsed and outputLength), so it can drive many machines
+// without a callback or stdio call per value.
+typedef struct {
+    const long long *input;
+    long long inputLength;
+    long long inputUsed;
+    long long *output;
+    long long outputCapacity;
+    long long outputLength;
+} IoBatch;
+
+bool batch_read(void *context, long long *value); // context is an IoBatch
+void batch_write(void *context, long long value); // context is an IoBatch
+
+// Execution counts gathered while a State's profile is set (intcode-profile.c). A profiled machine
+// always runs in the interpreter, never in native code, so that every instruction is counted.
+typedef struct {
+    long long instructions;
+    long long opcodes[100];
+    long long modes[100][3]; // Parameters read or written in each AddressMode, per opcode.
+    long long *hits; // Executions per address, below capacity.
+    long long *taken; // Jumps taken per address; the rest of a jump's hits fell through.
+    signed char *opcodeAt; // Last opcode executed at each address.
+    long long capacity;
+} Profile;
+
+Profile *profile_init();
+void profile_free(Profile *);
+void profile_reserve(Profile *, long long address); // Grows the per-address counts to cover address.
+// Opcode and mode histograms, then the hottest addresses (all of them if hottest is negative).
+void profile_report(Profile *, FILE *, int hottest);
+// One "root;OPCODE;address count" line per executed address, as read by flamegraph.pl.
+void profile_write_folded(Profile *, FILE *, const char *root);
+
+typedef struct {
+    Tape *tape;
+    long long ptr;
+    long long relativeBase;
+    Status status;
+    long long ticks; // Instructions executed so far.
+    long long tickLimit; // Execution pauses once ticks reaches this; see run_for.
+    long long outputs; // Values written so far.
+    IoDevice io;
+    QueuePair queues;
+    ChannelPair channels;
+    Profile *profile; // Owned by the caller; null unless profiling. Clones start unprofiled.
+} State;
+
+State *state_init(Tape *); // Defaults to stdio I/O.
+void state_free(State *); // This must *not* free the tape!
+void state_use_queues(State *, Queue *input, Queue *output); // Queues are owned by the caller.
+void state_use_channels(State *, Channel *input, Channel *output); // As are channels.
+void state_use_batch(State *, IoBatch *); // As is the batch.
+State *state_clone(State *, Tape *); // Copies registers and I/O setup onto the given tape.
+bool is_running(State *);
+void state_print_status(State *);
+long long read_next_value(State *);
+void advance_pointer(State *, long long);
+Instruction read_instruction(State *);
+DecodedInstruction read_decoded_instruction(State *);
+long long load_parameter(State *state, Instruction instr, int paramIdx);
+long long load_destination(State *state, Instruction instr, int paramIdx);
+void update_or_error(State *state, long long dest, long long value);
+Opcode tick(State *); // Returns the opcode that was executed.
+void run(State *);
+void run_until_output(State *);
+// Runs until the machine halts, fails, needs input, or has filled the batch's output span.
+Status run_batch(State *, IoBatch *);
+// Runs with the given values (parsed as numbers) as its only input, printing outputs as stdio_write
+// does. Reports an error if the program asks for more input than that.
+void run_with_inputs(State *, int count, char **values);
+
+// Why run_for gave control back. A machine that yielded for its budget or an output is still
+// RUNNING and can simply be run again.
+typedef enum { YIELD_BUDGET, YIELD_NEEDS_INPUT, YIELD_OUTPUT, YIELD_HALTED, YIELD_ERROR } YieldReason;
+
+// Runs at most maxInstructions instructions (exactly, in every engine), stopping early after
+// the first output, at a halt, on an error, or when input is needed.
+YieldReason run_for(State *, long long maxInstructions);
+
+// Instructions executed by every machine in this process so far. If INTCODE_STATS_FILE is set in
+// the environment, the total is written there at exit (as "instructions N") for bench harnesses.
+long long intcode_instructions();
+
+// A frozen machine (tape plus registers) that can be restored any number of times, so brute-force
+// searches pay for parsing once and only a tape copy per trial.
+typedef struct {
+    Tape *tape;
+    State *state;
+} Snapshot;
+
+Snapshot *snapshot_take(State *);
+State *snapshot_restore(Snapshot *); // The caller must free both the new State and its tape.
+void snapshot_free(Snapshot *);
+
+// Tier-2 execution (x86-64 only, enabled with INTCODE_JIT). The interpreter calls jit_enter on taken
+// jumps; it counts how often each address is reached and compiles hot straight-line blocks to native
+// code. Writes to a compiled address invalidate the tape's native code and resume interpretation.
+void jit_enter(State *);
+void jit_invalidate(Tape *, long long idx);
+void jit_free(Tape *);
+
+// Ahead-of-time translated programs, as emitted by intcode-aot. A tape whose parsed contents exactly
+// match a registered image runs the translation instead of the interpreter, until something writes
+// to one of its instruction cells; from then on that tape is interpreted.
+struct NativeProgram {
+    const long long *image;
+    long long length;
+    const unsigned char *codeCells; // Non-zero for every cell of a translated instruction.
+    // Runs from state->ptr. Returns true if it stopped for one of the usual reasons (halt, error,
+    // output when asked to stop on output) or false if the interpreter must take over at state->ptr.
+    bool (*run)(State *, bool stopOnOutput);
+};
+
+void native_register(const NativeProgram *);
+
+// An M:N scheduler (intcode-sched.c): many machines time-sliced over a pool of worker threads.
+// Each machine reads from its own inbox, which anyone may post to with scheduler_send; a machine
+// that runs out of input is parked until a message arrives. Outputs go wherever the machine's
+// io.write sends them, typically a handler that posts to another machine's inbox.
+typedef struct Scheduler Scheduler;
+
+typedef struct {
+    long long instructions; // Executed during scheduler_run calls.
+    double seconds; // Wall time spent in scheduler_run.
+    long long slices; // Times a machine was given a worker.
+    long long steals; // Slices taken from another worker's queue.
+    long long parks; // Times a machine blocked for input.
+} SchedulerStats;
+
+Scheduler *scheduler_init(int workers, long long timeSlice); // timeSlice is in instructions.
+void scheduler_free(Scheduler *); // Frees the inboxes but not the machines' States or tapes.
+int scheduler_add(Scheduler *, State *); // Returns the machine's id. Its input is replaced by its inbox.
+void scheduler_send(Scheduler *, int machine, long long value); // Safe from any thread.
+// Runs until every machine has halted, failed, or is parked with an empty inbox.
+void scheduler_run(Scheduler *);
+SchedulerStats scheduler_stats(Scheduler *);
+long long scheduler_queue_depth(Scheduler *, int machine);
+void scheduler_print_stats(Scheduler *, FILE *);
+
+#endif
@@ -0,0 +1,127 @@
+#define _DEFAULT_SOURCE
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "intcode.h"
+
+// Compares ways of parsing a large synthetic tape: fscanf per value (the old tape_parse), the scalar
+// parser, the SIMD parser, tape_load end to end, and mapping the same tape as an image.
+// Usage: parse-bench [megabytes]
+
+double elapsed_seconds(struct timespec *start, struct timespec *end);
+char *synthetic_tape(long long bytes, long long *length);
+
+int main(int argc, char **argv) {
+    long long megabytes = (argc > 1) ? atoll(argv[1]) : 100;
+    long long length;
+    char *text = synthetic_tape(megabytes << 20, &length);
+    char path[] = "/tmp/parse-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, text, length) != length) {
+        fprintf(stderr, "ERROR: Could not write the synthetic tape to %s.\n", path);
+        return 1;
+    }
+    close(fd);
+
+    long long capacity = tape_text_capacity(text, length);
+    long long *scalarValues = malloc(sizeof(long long) * capacity);
+    long long *simdValues = malloc(sizeof(long long) * capacity);
+    long long *expected = malloc(sizeof(long long) * capacity);
+    struct timespec start, end;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    FILE *f = fopen(path, "r");
+    long long count = 0;
+    while (count < capacity && fscanf(f, "%lld,", &expected[count]) == 1) {
+        count++;
+    }
+    fclose(f);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = elapsed_seconds(&start, &end);
+    printf("fscanf:   %lld values from %.1f MB in %.3fs (%.0f MB/s).\n", count, length / 1e6, seconds, length / seconds / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long scalarEnd;
+    long long scalar = tape_text_parse_scalar(text, length, scalarValues, capacity, &scalarEnd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = elapsed_seconds(&start, &end);
+    printf("Scalar:   %lld values in %.3fs (%.0f MB/s).\n", scalar, seconds, length / seconds / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long simdEnd;
+    long long simd = tape_text_parse(text, length, simdValues, capacity, &simdEnd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = elapsed_seconds(&start, &end);
+    printf("SIMD:     %lld values in %.3fs (%.0f MB/s).\n", simd, seconds, length / seconds / 1e6);
+
+    // Each parser has its own buffer, so both are checked against fscanf rather than just the last.
+    bool scalarSame = (scalarEnd == length && scalar == count
+                       && memcmp(scalarValues, expected, sizeof(long long) * count) == 0);
+    bool simdSame = (simdEnd == length && simd == count && memcmp(simdValues, expected, sizeof(long long) * count) == 0);
+    if (!scalarSame) {
+        fprintf(stderr, "ERROR: The scalar parser disagrees with fscanf.\n");
+    }
+    if (!simdSame) {
+        fprintf(stderr, "ERROR: The SIMD parser disagrees with fscanf.\n");
+    }
+    bool same = scalarSame && simdSame;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Tape *tape = tape_load(path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = elapsed_seconds(&start, &end);
+    printf("Loading:  %lld cells into a tape in %.3fs (%.0f MB/s).\n", tape->count, seconds, length / seconds / 1e6);
+
+    char imagePath[] = "/tmp/parse-bench-XXXXXX.tape";
+    fd = mkstemps(imagePath, strlen(".tape"));
+    close(fd);
+    if (fd < 0 || !tape_write_image(tape, imagePath, 0)) {
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Tape *mapped = tape_load(imagePath);
+    for (long long i = 0; i < mapped->count; i += TAPE_PAGE_SIZE) {
+        tape_get(mapped, i); // Touch every page, as running the tape would.
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = elapsed_seconds(&start, &end);
+    printf("Mapping:  %lld cells from a tape image in %.3fs.\n", mapped->count, seconds);
+
+    tape_free(mapped);
+    tape_free(tape);
+    unlink(imagePath);
+    unlink(path);
+    free(scalarValues);
+    free(simdValues);
+    free(expected);
+    free(text);
+    return same ? 0 : 1;
+}
+
+// Mostly short opcodes and addresses, with some large and negative constants, as in real tapes.
+char *synthetic_tape(long long bytes, long long *length) {
+    char *text = malloc(bytes + 32);
+    long long used = 0;
+    unsigned long long seed = 88172645463325252ULL;
+    while (used < bytes) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        int kind = seed % 16;
+        long long value = (kind < 10) ? (long long)(seed >> 8) % 1200
+                        : (kind < 14) ? (long long)(seed >> 8) % 100000
+                        : (long long)(seed >> 4) % 10000000000000LL;
+        if (kind % 5 == 4) {
+            value = -value;
+        }
+        used += snprintf(text + used, 32, "%lld,", value);
+    }
+    text[used - 1] = '\n';
+    *length = used;
+    return text;
+}
+
+double elapsed_seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
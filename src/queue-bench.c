@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "intcode.h"
+
+// Measures how fast values move through Queues, both on their own and as the I/O of a chain of
+// Intcode amplifiers that each echo their input.
+// Usage: queue-bench [values] [amplifiers]
+
+// in [9]; out [9]; jump to 0
+static const long long ECHO_PROGRAM[] = { 3, 9, 4, 9, 1105, 1, 0, 99, 0, 0 };
+
+#define MAX_CHAIN 64
+
+double elapsed_seconds(struct timespec *start, struct timespec *end);
+
+int main(int argc, char **argv) {
+    long long values = (argc > 1) ? atoll(argv[1]) : 1000000;
+    int amplifiers = (argc > 2) ? atoi(argv[2]) : 5;
+    if (amplifiers < 1 || amplifiers > MAX_CHAIN) {
+        fprintf(stderr, "ERROR: The chain must have between 1 and %d amplifiers.\n", MAX_CHAIN);
+        return 1;
+    }
+
+    Queue *queues[MAX_CHAIN + 1];
+    for (int i = 0; i <= amplifiers; i++) {
+        queues[i] = queue_init();
+    }
+
+    // Plain queues: each value is appended to and retrieved from every queue in turn. Every queue
+    // starts with a few values in it, as a queue between busy amplifiers would.
+    for (int i = 0; i <= amplifiers; i++) {
+        for (int j = 0; j < 4; j++) {
+            queue_append(queues[i], -1);
+        }
+    }
+    struct timespec start, end;
+    long long checksum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long long v = 0; v < values; v++) {
+        queue_append(queues[0], v);
+        for (int i = 0; i < amplifiers; i++) {
+            queue_append(queues[i + 1], queue_retrieve(queues[i]));
+        }
+        checksum += queue_retrieve(queues[amplifiers]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = elapsed_seconds(&start, &end);
+    printf("Queues: %lld values through %d queues in %.3fs (%.1f M queue operations/s). Checksum %lld.\n",
+           values, amplifiers, seconds, values * amplifiers / seconds / 1e6, checksum);
+
+    // Amplifier chain: every value makes one INPUT and one OUTPUT per amplifier.
+    for (int i = 0; i <= amplifiers; i++) {
+        while (!queue_is_empty(queues[i])) {
+            queue_retrieve(queues[i]);
+        }
+    }
+    Tape *echo = tape_init();
+    for (int i = 0; i < sizeof(ECHO_PROGRAM) / sizeof(ECHO_PROGRAM[0]); i++) {
+        tape_append(echo, ECHO_PROGRAM[i]);
+    }
+    State *states[MAX_CHAIN];
+    for (int i = 0; i < amplifiers; i++) {
+        states[i] = state_init(tape_clone(echo));
+        state_use_queues(states[i], queues[i], queues[i + 1]);
+    }
+
+    checksum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long long v = 0; v < values; v++) {
+        queue_append(queues[0], v);
+        for (int i = 0; i < amplifiers; i++) {
+            run_until_output(states[i]);
+        }
+        checksum += queue_retrieve(queues[amplifiers]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = elapsed_seconds(&start, &end);
+    printf("Amplifier chain: %lld values through %d amplifiers in %.3fs (%.1f M values/s). Checksum %lld.\n",
+           values, amplifiers, seconds, values / seconds / 1e6, checksum);
+
+    for (int i = 0; i < amplifiers; i++) {
+        tape_free(states[i]->tape);
+        state_free(states[i]);
+    }
+    for (int i = 0; i <= amplifiers; i++) {
+        queue_free(queues[i]);
+    }
+    tape_free(echo);
+}
+
+double elapsed_seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
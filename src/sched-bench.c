@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+#include "intcode.h"
+
+// Measures the scheduler with a ring of relay machines: each reads a token, adds one and passes it
+// to the next machine, until every token has made the given number of hops.
+// Usage: sched-bench [machines] [tokens] [hops] [workers] [time slice]
+
+// in [100]; [100] += 1; out [100]; jump to 0
+static const long long RELAY_PROGRAM[] = { 3, 100, 1001, 100, 1, 100, 4, 100, 1105, 1, 0 };
+
+typedef struct {
+    Scheduler *scheduler;
+    int next;
+    long long hops;
+    long long *finished;
+} Relay;
+
+void relay_write(void *context, long long value) {
+    Relay *relay = context;
+    if (value < relay->hops) {
+        scheduler_send(relay->scheduler, relay->next, value);
+    } else {
+        __atomic_add_fetch(relay->finished, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int main(int argc, char **argv) {
+    int machines = (argc > 1) ? atoi(argv[1]) : 1000;
+    long long tokens = (argc > 2) ? atoll(argv[2]) : 100;
+    long long hops = (argc > 3) ? atoll(argv[3]) : 100000;
+    int workers = (argc > 4) ? atoi(argv[4]) : 4;
+    long long timeSlice = (argc > 5) ? atoll(argv[5]) : 1000;
+    if (machines < 1 || tokens < 1 || hops < 1) {
+        fprintf(stderr, "ERROR: Machines, tokens and hops must all be positive.\n");
+        return 1;
+    }
+
+    Tape *relay = tape_init();
+    for (int i = 0; i < sizeof(RELAY_PROGRAM) / sizeof(RELAY_PROGRAM[0]); i++) {
+        tape_append(relay, RELAY_PROGRAM[i]);
+    }
+
+    Scheduler *scheduler = scheduler_init(workers, timeSlice);
+    State **states = malloc(sizeof(State *) * machines);
+    Relay *relays = malloc(sizeof(Relay) * machines);
+    long long finished = 0;
+    for (int i = 0; i < machines; i++) {
+        relays[i].scheduler = scheduler;
+        relays[i].next = (i + 1) % machines;
+        relays[i].hops = hops;
+        relays[i].finished = &finished;
+        states[i] = state_init(tape_clone(relay));
+        states[i]->io.write = relay_write;
+        states[i]->io.context = &relays[i];
+        scheduler_add(scheduler, states[i]);
+    }
+
+    // Tokens start spread evenly around the ring.
+    for (long long t = 0; t < tokens; t++) {
+        scheduler_send(scheduler, (int)(t * machines / tokens), 0);
+    }
+    scheduler_run(scheduler);
+
+    SchedulerStats stats = scheduler_stats(scheduler);
+    printf("Relay: %lld of %lld tokens made %lld hops around %d machines (%.2f M hops/s).\n",
+           finished, tokens, hops, machines, tokens * hops / stats.seconds / 1e6);
+    scheduler_print_stats(scheduler, stdout);
+
+    for (int i = 0; i < machines; i++) {
+        tape_free(states[i]->tape);
+        state_free(states[i]);
+    }
+    scheduler_free(scheduler);
+    free(states);
+    free(relays);
+    tape_free(relay);
+    return (finished == tokens) ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "intcode.h"
+
+// Checks that tapes cost memory in proportion to the pages written, wherever those pages are.
+// Usage: tape-test
+
+#define HIGH_ADDRESS 1000000000000LL
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s.\n", what);
+        failures++;
+    }
+}
+
+static void test_high_write_and_clone() {
+    Tape *tape = tape_init();
+    check(tape_update(tape, 5, 1), "writing a low address");
+    check(tape_update(tape, HIGH_ADDRESS, 42), "writing a huge address");
+    check(tape_get(tape, HIGH_ADDRESS) == 42, "reading back the huge address");
+    check(tape_get(tape, HIGH_ADDRESS + TAPE_PAGE_SIZE) == 0, "reading past it as zero");
+    check(tape->count == HIGH_ADDRESS + 1, "the count covers the huge address");
+    check(tape->pageCount <= 1, "the dense directory stays at the low pages");
+    check(tape->sparseCount == 1 && tape->sparseCapacity <= 16, "one high page takes one table slot");
+
+    Tape *clone = tape_clone(tape);
+    check(clone->pageCount == tape->pageCount && clone->sparseCapacity == tape->sparseCapacity,
+          "a clone's directory is the size of its source's");
+    check(tape_page(clone, HIGH_ADDRESS) == tape_page(tape, HIGH_ADDRESS), "a clone shares the high page");
+    check(tape_update(clone, HIGH_ADDRESS, 7), "writing the clone's high page");
+    check(tape_get(clone, HIGH_ADDRESS) == 7 && tape_get(tape, HIGH_ADDRESS) == 42,
+          "writing a clone's page leaves its source alone");
+    check(tape_page(clone, HIGH_ADDRESS) != tape_page(tape, HIGH_ADDRESS), "the written page was copied");
+    tape_free(clone);
+    check(tape_get(tape, HIGH_ADDRESS) == 42, "the source outlives its clone");
+    tape_free(tape);
+}
+
+static void test_many_high_pages() {
+    Tape *tape = tape_init();
+    for (long long i = 0; i < 5000; i++) {
+        tape_update(tape, HIGH_ADDRESS + i * 7919 * TAPE_PAGE_SIZE, i);
+    }
+    bool allThere = true;
+    for (long long i = 0; i < 5000; i++) {
+        allThere = allThere && tape_get(tape, HIGH_ADDRESS + i * 7919 * TAPE_PAGE_SIZE) == i;
+    }
+    check(allThere, "every scattered high page keeps its value");
+    check(tape->sparseCount == 5000 && tape->sparseCapacity <= 16384, "the table grows with the pages written");
+    tape_free(tape);
+}
+
+static void collect_output(void *context, long long value) {
+    *(long long *)context = value;
+}
+
+// Counts to 1000 in a cell a trillion cells up, which is hot enough to be compiled where the JIT
+// is built in.
+static void test_program_on_high_page() {
+    static const long long program[] = {
+        109, HIGH_ADDRESS,   // rb = 10^12
+        21201, 0, 1, 0,      // [rb] += 1
+        21207, 0, 1000, 1,   // [rb + 1] = [rb] < 1000
+        1205, 1, 2,          // if [rb + 1], go back
+        204, 0,              // output [rb]
+        99,
+    };
+    Tape *tape = tape_init();
+    tape_append_values(tape, program, sizeof(program) / sizeof(program[0]));
+    State *state = state_init(tape);
+    long long output = 0;
+    state->io.write = collect_output;
+    state->io.context = &output;
+    run(state);
+    check(state->status == COMPLETE && output == 1000, "running a program on a high page");
+    check(tape->pageCount <= 1, "the program didn't grow the dense directory");
+    state_free(state);
+    tape_free(tape);
+}
+
+int main() {
+    test_high_write_and_clone();
+    test_many_high_pages();
+    test_program_on_high_page();
+    if (failures == 0) {
+        printf("All tape checks passed.\n");
+    }
+    return (failures == 0) ? 0 : 1;
+}